@@ -25,11 +25,92 @@ extern "C" {
 #define AMT_SERVICE_UUID             0x1523
 #define AMTS_CHAR_UUID               0x1524
 #define AMT_RCV_BYTES_CNT_CHAR_UUID  0x1525
-
-#define AMT_RCV_BYTES_CNT_MAX_LEN    (4)
+#define AMT_WRITE_CHAR_UUID          0x1526
+
+#define AMT_NOTIF_HDR_LEN            (5)            /**< Length of the header of each notification: 32-bit offset followed by a flags byte. */
+#define AMT_NOTIF_FLAG_DUPLEX        (0x01)         /**< The receiver should stream Write Without Response back while the transfer is running. */
+#define AMT_NOTIF_FLAG_LAST          (0x02)         /**< Last notification of the transfer. */
+#define AMT_NOTIF_FLAG_WRITE_REQ     (0x04)         /**< No payload, the receiver should write the number of bytes given in the offset field. */
+#define AMT_NOTIF_FLAG_PACED         (0x08)         /**< The transfer is paced at a constant bitrate, the receiver should report arrival statistics. */
+#define AMT_NOTIF_FLAG_TIMED         (0x80)         /**< The transfer runs for a fixed time and is ended by a header without payload, flagged AMT_NOTIF_FLAG_LAST. */
+#define AMT_NOTIF_PAYLOAD_Pos        (4)            /**< Position of the @ref amt_payload_t field in the flags byte. */
+#define AMT_NOTIF_PAYLOAD_Msk        (0x70)         /**< Mask of the @ref amt_payload_t field in the flags byte. */
+#define AMT_PAYLOAD_CRC_LEN          (4)            /**< Length of the CRC32 trailer of @ref AMT_PAYLOAD_FIXED_CRC32 notifications. */
+
+#define AMT_RCV_BYTES_CNT_VERSION    (1)            /**< Version of the Received Bytes Count characteristic format: version byte followed by a 64-bit count. */
+#define AMT_RCV_BYTES_CNT_LEGACY_LEN (4)            /**< Length of the legacy Received Bytes Count value, a 32-bit count without version byte. */
+#define AMT_RCV_BYTES_CNT_MAX_LEN    (1 + 8)
 #define AMT_BYTE_TRANSFER_CNT_DEFAULT (1024*1024)
 
-extern uint32_t amt_byte_transfer_count;
+#define AMTS_RTT_HIST_SUB_BINS       (8)            /**< Number of round-trip time histogram bins per power of two. */
+#define AMTS_RTT_HIST_SIZE           (152)          /**< Number of round-trip time histogram bins, the last one also holds all round trips above 60 s. */
+#define AMTS_TX_COMPLETE_HIST_SIZE   (16)           /**< Number of bins in the packets per TX_COMPLETE histogram. The last bin also counts larger values. */
+#define AMTS_MILESTONE_CNT           (32)           /**< Number of byte milestones kept per transfer, must be even. */
+#define AMTS_MILESTONE_STEP_MIN      (1024)         /**< Initial spacing of the byte milestones. */
+
+extern uint64_t amt_byte_transfer_count;
+
+
+/**@brief Content of the notification payload after the header.
+ *
+ * @details The content does not depend on the offset, so that every notification of a given length
+ *          carries the same payload. Like in the Direct Test Mode, the PRBS generators restart from
+ *          the all-ones state at the start of each payload.
+ */
+typedef enum
+{
+    AMT_PAYLOAD_NONE,                           //!< All zeros, not verified. */
+    AMT_PAYLOAD_INCREMENTING,                   //!< Byte i of the payload is i modulo 256. */
+    AMT_PAYLOAD_PRBS9,                          //!< PRBS9 (x^9 + x^5 + 1), MSB first. */
+    AMT_PAYLOAD_PRBS15,                         //!< PRBS15 (x^15 + x^14 + 1), MSB first. */
+    AMT_PAYLOAD_FIXED_CRC32,                    //!< 0xA5 followed by the CRC32 of the whole notification up to the trailer. */
+    AMT_PAYLOAD_CNT
+} amt_payload_t;
+
+
+/**@brief     Function for filling the payload of a notification.
+ *
+ * @details   Fills the bytes after the header. For @ref AMT_PAYLOAD_FIXED_CRC32 the CRC trailer is
+ *            left out, call @ref nrf_ble_amt_payload_seal once the header is in place.
+ *
+ * @param[in] type      Payload content, see @ref amt_payload_t.
+ * @param     p_data    Notification, including the header.
+ * @param[in] len       Length of the notification, including the header.
+ */
+void nrf_ble_amt_payload_fill(uint8_t type, uint8_t * p_data, uint16_t len);
+
+
+/**@brief     Function for writing the CRC32 trailer of a @ref AMT_PAYLOAD_FIXED_CRC32 notification.
+ *
+ * @details   Does nothing for the other payload types.
+ *
+ * @param[in] type      Payload content, see @ref amt_payload_t.
+ * @param     p_data    Notification, including the header.
+ * @param[in] len       Length of the notification, including the header.
+ */
+void nrf_ble_amt_payload_seal(uint8_t type, uint8_t * p_data, uint16_t len);
+
+
+/**@brief     Function for verifying the payload of a received notification or write.
+ *
+ * @details   CRC32 payloads are checked against their trailer. The others are compared with a
+ *            copy generated once per payload type and length, so the per-packet cost is a memcmp().
+ *            The copy is shared by all callers.
+ *
+ * @param[in] p_data    Notification or write, including the header.
+ * @param[in] len       Length of the notification or write, including the header.
+ * @param[in] type      Payload type decoded from the header, see @ref amt_payload_t.
+ *
+ * @retval    true if the payload matches or is not verified, false otherwise.
+ */
+bool nrf_ble_amt_payload_check(uint8_t const * p_data, uint16_t len, uint8_t type);
+
+
+/**@brief     Function for computing the CRC-32 (IEEE 802.3) of a buffer.
+ *
+ * @details   Uses a 16-entry table, two lookups per byte.
+ */
+uint32_t nrf_ble_amt_crc32(uint8_t const * p_data, uint32_t len);
 
 /**
  * @defgroup nrf_ble_amt ATT MTU Throughput (AMT) Service Client
@@ -50,6 +131,7 @@ typedef struct
     uint16_t amt_cccd_handle;                  //!<  Handle of the CCCD . */
     uint16_t amt_handle;                       //!<  Handle of the characteristic as provided by the SoftDevice. */
     uint16_t amt_rbc_handle;                   //!<  Handle of the Number of received bytes  characteristic as provided by the SoftDevice. */
+    uint16_t amt_write_handle;                 //!<  Handle of the Write Without Response characteristic as provided by the SoftDevice. */
 } nrf_ble_amtc_db_t;
 
 /**@brief AMT Client event type. */
@@ -57,7 +139,9 @@ typedef enum
 {
     NRF_BLE_AMT_C_EVT_DISCOVERY_COMPLETE = 1,  //!<  Event indicating that the peer throughput Service has been discovered at the peer. */
     NRF_BLE_AMT_C_EVT_NOTIFICATION,            //!<  Event indicating that a notification has been received from the peer. */
-    NRF_BLE_AMT_C_EVT_RBC_READ_RSP             //!<  Event indicating that a Number of received bytes notification has been received from the peer. */
+    NRF_BLE_AMT_C_EVT_RBC_READ_RSP,            //!<  Event indicating that a Number of received bytes notification has been received from the peer. */
+    NRF_BLE_AMT_C_EVT_WRITE_REQ,               //!<  Event indicating that the peer requested a Write Without Response transfer. */
+    NRF_BLE_AMT_C_EVT_WRITE_COMPLETE           //!<  Event indicating that all writes of a bounded transfer have been sent. */
 } nrf_ble_amtc_evt_type_t;
 
 
@@ -65,11 +149,41 @@ typedef enum
 typedef struct
 {
     uint16_t           notif_len;                //!<  Length of the received notification.*/
-    uint32_t           bytes_sent;               //!<  Decoded number of bytes sent by the peer.*/
-    uint32_t           bytes_rcvd;               //!<  Number of bytes received from the peer since the beggining of the transfer.*/
+    uint32_t           bytes_sent;               //!<  Decoded number of bytes sent by the peer, modulo 2^32.*/
+    uint64_t           bytes_rcvd;               //!<  Number of bytes received from the peer since the beggining of the transfer.*/
+    uint8_t            flags;                    //!<  AMT_NOTIF_FLAG_* bits decoded from the notification header.*/
+    uint8_t const    * p_data;                   //!<  Received notification, header included. AMT_NOTIF_HDR_LEN bytes long when notif_len is 0. Only valid in the event handler.*/
+    bool               transfer_start;           //!<  First notification received of a new transfer, the statistics have been cleared. Also set when the actual first one was lost.*/
 } nrf_ble_amtc_notif_t;
 
 
+/**@brief Integrity of the received notification stream, checked against the offset in each header. */
+typedef struct
+{
+    uint32_t next_offset;                        //!<  Offset at which the next notification is expected to start, modulo 2^32. */
+    uint32_t gap_start;                          //!<  Start of the most recent gap, used to tell reordered packets from duplicates. */
+    uint32_t gap_end;                            //!<  End of the most recent gap. */
+    uint32_t gap_cnt;                            //!<  Number of times a notification started past the expected offset. */
+    uint32_t dup_cnt;                            //!<  Number of notifications with data that had already been received. */
+    uint32_t reorder_cnt;                        //!<  Number of notifications that arrived late at an edge of the most recent gap. */
+    uint32_t corrupt_cnt;                        //!<  Number of notifications whose payload did not match the generator in the header. */
+    uint64_t lost_bytes;                         //!<  Number of bytes skipped by gaps and not filled later. */
+    uint64_t goodput_bytes;                      //!<  Number of unique bytes received in the transfer. */
+} nrf_ble_amtc_seq_stats_t;
+
+
+/**@brief Arrival times of the notifications of a transfer, in counter ticks. */
+typedef struct
+{
+    uint64_t first_ticks;                        //!<  Arrival of the first notification. */
+    uint64_t last_ticks;                         //!<  Arrival of the last notification. */
+    uint32_t gap_last;                           //!<  Inter-arrival time before the last notification. */
+    uint32_t gap_max;                            //!<  Longest inter-arrival time. */
+    uint32_t gap_cnt;                            //!<  Number of inter-arrival times measured. */
+    uint64_t jitter_sum;                         //!<  Sum of the differences between consecutive inter-arrival times. */
+} nrf_ble_amtc_arrival_stats_t;
+
+
 /**@brief AMT Event structure. */
 typedef struct
 {
@@ -79,7 +193,9 @@ typedef struct
     {
         nrf_ble_amtc_db_t    peer_db;           //!<  Handles found on the peer device. This will be filled if the evt_type is @ref NRF_BLE_AMT_C_EVT_DISCOVERY_COMPLETE.*/
         nrf_ble_amtc_notif_t hvx;               //!<  Notification data. This will be filled if the evt_type is @ref NRF_BLE_AMT_C_EVT_NOTIFICATION.*/
-        uint32_t             rcv_bytes_cnt;     //!<  Number of received bytes by the peer. This will be filled if the evt_type is @ref NRF_BLE_AMT_C_EVT_RBC_NOTIFICATION.*/
+        uint64_t             rcv_bytes_cnt;     //!<  Number of received bytes by the peer. This will be filled if the evt_type is @ref NRF_BLE_AMT_C_EVT_RBC_NOTIFICATION.*/
+        uint32_t             write_req_len;     //!<  Number of bytes requested by the peer. This will be filled if the evt_type is @ref NRF_BLE_AMT_C_EVT_WRITE_REQ.*/
+        uint64_t             bytes_written;     //!<  Number of bytes written to the peer. This will be filled if the evt_type is @ref NRF_BLE_AMT_C_EVT_WRITE_COMPLETE.*/
     } params;
 } nrf_ble_amtc_evt_t;
 
@@ -101,7 +217,19 @@ typedef struct nrf_ble_amtc_t
     nrf_ble_amtc_db_t          peer_db;          //!<  Handles on the peer*/
     nrf_ble_amtc_evt_handler_t evt_handler;      //!<  Application event handler to be called when there is an event related to this AMT Client Module. */
     uint8_t                    uuid_type;        //!<  UUID type. */
-    uint32_t                   bytes_rcvd_cnt;   //!<  Number of bytes received.*/
+    uint64_t                   bytes_rcvd_cnt;   //!<  Number of bytes received in the current transfer, including duplicates.*/
+    nrf_ble_amtc_seq_stats_t   seq_stats;        //!<  Integrity of the current transfer. */
+    nrf_ble_amtc_arrival_stats_t arrival_stats;  //!<  Arrival times of the current transfer. */
+    bool                       seq_ended;        //!<  The last notification ended the transfer, the next one starts a new one. */
+    uint16_t                   max_payload_len;  //!<  Maximum number of bytes which can be sent in one write. */
+    uint8_t                    tx_credits;       //!<  Number of free SoftDevice TX buffers for writes. */
+    uint8_t                    tx_credits_max;   //!<  Number of SoftDevice TX buffers of the link, tx_credits never goes above it. */
+    uint8_t                    tx_pending;       //!<  Number of writes queued in the SoftDevice and not yet completed. */
+    bool                       writing;          //!<  Whether Write Without Response streaming is active. */
+    uint64_t                   bytes_written;    //!<  Number of bytes written to the peer since streaming was started. */
+    uint64_t                   write_limit;      //!<  Number of bytes to write before the transfer completes, 0 to write until stopped. */
+    uint8_t                    write_payload_type; //!<  @ref amt_payload_t of the writes, taken from the last notification of the peer. */
+    uint8_t                    write_buf[NRF_BLE_GATT_MAX_MTU_SIZE]; //!<  Prebuilt write, only the header is rewritten for each packet. */
 } nrf_ble_amtc_t;
 
 
@@ -135,7 +263,7 @@ void nrf_ble_amtc_on_ble_evt(nrf_ble_amtc_t * p_ctx, const ble_evt_t * p_ble_evt
 
 /**@brief   Function for enabling CCCD on the peer.
  *
- * @details This function will enable to notification of AMT at the peer
+ * @details This function will enable notifications and indications of AMT at the peer
  *          by writing to the CCCD of the AMT Characteristic.
  *
  * @param   p_ctx Pointer to the AMT client structure.
@@ -190,6 +318,38 @@ ret_code_t nrf_ble_amtc_handles_assign(nrf_ble_amtc_t * p_ctx,
 ret_code_t nrf_ble_amtc_rcb_read(nrf_ble_amtc_t * p_ctx);
 
 
+/**@brief     Function for starting to stream Write Without Response to the peer.
+ *
+ * @details   The module keeps writing to the AMT Write characteristic on the peer, as fast as
+ *            TX buffers are freed, until byte_cnt bytes have been written,
+ *            @ref nrf_ble_amtc_write_spam_stop is called or the link is disconnected.
+ *            For a bounded transfer, @ref NRF_BLE_AMT_C_EVT_WRITE_COMPLETE is sent once
+ *            the SoftDevice has completed the last write.
+ *
+ * @param     p_ctx          Pointer to the AMT client structure.
+ * @param[in] byte_cnt       Number of bytes to write, 0 to write until stopped.
+ *
+ * @retval    NRF_SUCCESS              Streaming started.
+ * @retval    NRF_ERROR_INVALID_STATE  Not connected, or the peer has no AMT Write characteristic.
+ */
+ret_code_t nrf_ble_amtc_write_spam_start(nrf_ble_amtc_t * p_ctx, uint64_t byte_cnt);
+
+
+/**@brief     Function for stopping the Write Without Response stream.
+ *
+ * @param     p_ctx          Pointer to the AMT client structure.
+ */
+void nrf_ble_amtc_write_spam_stop(nrf_ble_amtc_t * p_ctx);
+
+
+/**@brief     Function for handling the GATT module's events.
+ *
+ * @param     p_ctx       Pointer to the AMT client structure.
+ * @param[in] p_gatt_evt  Event received from the GATT module.
+ */
+void nrf_ble_amtc_on_gatt_evt(nrf_ble_amtc_t * p_ctx, nrf_ble_gatt_evt_t * p_gatt_evt);
+
+
 
 /** @} */ // End tag for the Client.
 
@@ -216,6 +376,9 @@ typedef enum
     SERVICE_EVT_NOTIF_DISABLED,
     SERVICE_EVT_TRANSFER_1KB,
     SERVICE_EVT_TRANSFER_FINISHED,
+    SERVICE_EVT_WRITE_STARTED,
+    SERVICE_EVT_WRITE_FINISHED,
+    SERVICE_EVT_TX_READY,                   //!< TX buffers were freed after all were in use, while no transfer was running, see @ref nrf_ble_amts_notif_forward. */
 } nrf_ble_amts_evt_type_t;
 
 
@@ -223,10 +386,53 @@ typedef enum
 typedef struct
 {
     nrf_ble_amts_evt_type_t evt_type;                       //!< Type of the event. */
-    uint32_t                bytes_transfered_cnt;           //!< Number of bytes sent during the transfer*/
+    uint16_t                conn_handle;                    //!< Connection handle on which the event occurred. */
+    uint64_t                bytes_transfered_cnt;           //!< Number of bytes sent during the transfer*/
 } nrf_ble_amts_evt_t;
 
 
+/**@brief Packets completed per BLE_EVT_TX_COMPLETE event during a transfer. */
+typedef struct
+{
+    uint32_t evt_cnt;                                //!< Number of TX_COMPLETE events. */
+    uint32_t pkt_cnt;                                //!< Total number of packets completed. */
+    uint8_t  min;                                    //!< Lowest number of packets completed in one event. */
+    uint8_t  max;                                    //!< Highest number of packets completed in one event. */
+    uint32_t hist[AMTS_TX_COMPLETE_HIST_SIZE];       //!< Number of events per completed packet count. */
+} nrf_ble_amts_tx_stats_t;
+
+
+/**@brief Indication round-trip times of a transfer, in counter ticks.
+ *
+ * @details The histogram has AMTS_RTT_HIST_SUB_BINS bins per power of two, which keeps the
+ *          percentiles within 12.5 % of the measured value over the whole range.
+ */
+typedef struct
+{
+    uint32_t cnt;                                    //!< Number of confirmed indications. */
+    uint32_t min;                                    //!< Shortest round-trip time. */
+    uint32_t max;                                    //!< Longest round-trip time. */
+    uint64_t sum;                                    //!< Sum of all round-trip times. */
+    uint32_t hist[AMTS_RTT_HIST_SIZE];               //!< Number of round trips per bin. */
+} nrf_ble_amts_rtt_stats_t;
+
+
+/**@brief Timestamped byte milestones of a transfer, for measuring the throughput over part of it.
+ *
+ * @details Milestone k is taken when k * step bytes have been delivered. When all entries are used,
+ *          every other one is dropped and the step is doubled, so the milestones always span the
+ *          whole transfer whatever its length.
+ */
+typedef struct
+{
+    uint64_t bytes[AMTS_MILESTONE_CNT];              //!< Bytes delivered when the milestone was taken. */
+    uint64_t ticks[AMTS_MILESTONE_CNT];              //!< Counter value when the milestone was taken. */
+    uint32_t cnt;                                    //!< Number of milestones taken. */
+    uint64_t step;                                   //!< Bytes between two milestones. */
+    uint64_t delivered;                              //!< Bytes delivered so far. */
+} nrf_ble_amts_milestones_t;
+
+
 /**@brief AMTS module event handler type.
  * The AMTS module will call this function when notifications have been enabled/disabled, for each Kilobytes sent and at the end of the tranfer.
 */
@@ -241,11 +447,39 @@ typedef struct
     uint8_t                  uuid_type;              //!< UUID type. */
     ble_gatts_char_handles_t amts_char_handles;      //!< AMT characteristic handles */
     ble_gatts_char_handles_t amt_rbc_char_handles;   //!< Received Bytes Count Characteristic handles. */
+    ble_gatts_char_handles_t amt_write_char_handles; //!< Write Without Response characteristic handles. */
     amts_evt_handler_t       evt_handler;            //!< Application event handler to be called when there is an event related to the AMTS module. */
-    bool                     busy;                   //!< busy flag, indicates that the hvx function returned busy and that there are still data to be transfered. */
+    bool                     busy;                   //!< busy flag, indicates that there are still data to be transfered. */
+    uint8_t                  tx_credits;             //!< Number of free SoftDevice TX buffers, queried at connection and refilled by TX_COMPLETE events. */
+    uint8_t                  tx_credits_max;         //!< Number of SoftDevice TX buffers of the link, tx_credits never goes above it. */
     uint16_t                 max_payload_len;        //!< Maximum number of bytes which can be sent in one notification. */
     uint32_t                 kbytes_sent;            //!< number of kiloBytes sent. */
-    uint32_t                 bytes_sent;             //!< number of bytes sent. */
+    uint64_t                 bytes_sent;             //!< number of bytes sent. */
+    nrf_ble_amts_tx_stats_t  tx_stats;               //!< Packets per TX_COMPLETE statistics of the current or last transfer. */
+    uint8_t                  notif_flags;            //!< AMT_NOTIF_FLAG_* bits to set in the header of each notification, set by the application. */
+    uint8_t                  payload_type;           //!< Payload content of the notifications, see @ref amt_payload_t. Set by the application. */
+    uint8_t                  hdr_flags;              //!< Flags byte of the current transfer, without AMT_NOTIF_FLAG_LAST. */
+    uint8_t                  notif_buf_type;         //!< Payload type notif_buf was built for. */
+    uint16_t                 notif_len;              //!< Length of notif_buf, the maximum payload length when it was built. 0 until built. */
+    uint16_t                 hvx_len;                //!< Length passed to, and updated by, sd_ble_gatts_hvx(). */
+    ble_gatts_hvx_params_t   hvx_params;             //!< Parameters for sd_ble_gatts_hvx(), pointing to notif_buf. */
+    uint8_t                  notif_buf[NRF_BLE_GATT_MAX_MTU_SIZE]; //!< Prebuilt notification, only the header is rewritten for each packet. */
+    bool                     indicate;               //!< Send the transfer as indications, one at a time, instead of notifications. Set by the application. */
+    bool                     hvc_pending;            //!< An indication has been sent and is waiting for its confirmation. */
+    uint64_t                 hvx_ticks;              //!< Counter value when the pending indication was sent. */
+    nrf_ble_amts_rtt_stats_t rtt_stats;              //!< Indication round-trip times of the current or last transfer. */
+    nrf_ble_amts_milestones_t milestones;            //!< Delivered byte milestones of the current or last transfer. */
+    uint32_t                 pace_rate;              //!< Target rate of notifications in bytes per second, 0 to send as fast as possible. Set by the application. */
+    uint64_t                 pace_credit;            //!< Bytes released by the token bucket and not sent yet, scaled by COUNTER_FREQ_HZ. */
+    uint64_t                 pace_ticks;             //!< Counter value at the last token bucket refill. */
+    uint32_t                 pace_backlog_max;       //!< Deepest backlog seen during the transfer, in bytes. */
+    bool                     timed;                  //!< Run until nrf_ble_amts_transfer_stop() instead of up to amt_byte_transfer_count. Set by the application. */
+    bool                     stop_pending;           //!< The transfer has been stopped and the end marker is waiting to be sent. */
+    uint64_t                 stop_delivered;         //!< Bytes confirmed by the peer when the timed transfer was stopped. */
+    uint64_t                 bytes_rcvd;             //!< number of bytes received through the Write Without Response characteristic. */
+    uint64_t                 write_expected;         //!< number of bytes still expected from a requested write transfer, 0 when none is running. */
+    uint64_t                 write_rcvd;             //!< number of bytes received in the current write transfer. */
+    uint32_t                 write_corrupt_cnt;      //!< number of writes of the current transfer whose payload did not match the generator in the header. */
 } nrf_ble_amts_t;
 
 
@@ -277,13 +511,103 @@ void nrf_ble_amts_init(nrf_ble_amts_t * p_ctx, amts_evt_handler_t evt_handler);
 /**@brief     Function for sending AMT_BYTE_TRANSFER_CNT bytes via notifications.
  *
  * @details   Call this function to start sending notifications. The module will keep sending notifications
- *            until AMT_BYTE_TRANSFER_CNT bytes has been sent.
+ *            until AMT_BYTE_TRANSFER_CNT bytes has been sent. If indicate is set, the data is sent as
+ *            indications instead, with one outstanding at a time, and the transfer finishes when the
+ *            last one has been confirmed.
  *
  * @param     p_ctx       Pointer to the AMTS structure.
  */
 void nrf_ble_amts_notif_spam(nrf_ble_amts_t * p_ctx);
 
 
+/**@brief     Function for refilling the token bucket of a paced transfer.
+ *
+ * @details   Releases pace_rate bytes per second since the last refill and sends as many
+ *            notifications as the released bytes and the free TX buffers allow. The application
+ *            calls this periodically, e.g. from an app_timer, while a paced transfer is running.
+ *            The rate does not depend on the calling interval, only the burstiness does.
+ *
+ * @param     p_ctx       Pointer to the AMTS structure.
+ */
+void nrf_ble_amts_pace_refill(nrf_ble_amts_t * p_ctx);
+
+
+/**@brief     Function for getting the throughput over the middle of the last transfer.
+ *
+ * @details   Leaves out the queue filling up at the start and the partial connection event at the
+ *            end, which skew the average of short transfers. The window is taken between the first
+ *            milestone at or after @p trim_percent of the delivered bytes and the last milestone at or
+ *            before 100 - @p trim_percent of them.
+ *
+ * @param[in]  p_ctx          Pointer to the AMTS structure.
+ * @param[in]  trim_percent   Share of the bytes to leave out at each end, 0 to 49.
+ * @param[out] p_bytes        Bytes delivered within the window.
+ * @param[out] p_ticks        Duration of the window, in counter ticks.
+ *
+ * @retval    NRF_SUCCESS              The window was found.
+ * @retval    NRF_ERROR_INVALID_STATE  The transfer was too short to hold two milestones in the window.
+ */
+ret_code_t nrf_ble_amts_steady_window_get(nrf_ble_amts_t const * p_ctx,
+                                          uint8_t                trim_percent,
+                                          uint64_t             * p_bytes,
+                                          uint64_t             * p_ticks);
+
+
+/**@brief     Function for stopping a timed transfer.
+ *
+ * @details   No more data is queued after this call. A header without payload, flagged
+ *            AMT_NOTIF_FLAG_LAST, is sent to the peer as soon as a TX buffer is free, and then
+ *            @ref SERVICE_EVT_TRANSFER_FINISHED is sent with the number of bytes the peer had
+ *            confirmed at this call. Data still queued in the SoftDevice is sent, but not counted.
+ *
+ * @param     p_ctx       Pointer to the AMTS structure.
+ */
+void nrf_ble_amts_transfer_stop(nrf_ble_amts_t * p_ctx);
+
+
+/**@brief     Function for getting a percentile of the indication round-trip times.
+ *
+ * @param[in] p_stats   Pointer to the round-trip time statistics.
+ * @param[in] percent   Percentile to get, 1 to 100.
+ *
+ * @return    Upper bound of the histogram bin holding the percentile, capped by the longest
+ *            round-trip time, in counter ticks. 0 if there are no samples.
+ */
+uint32_t nrf_ble_amts_rtt_percentile_get(nrf_ble_amts_rtt_stats_t const * p_stats, uint8_t percent);
+
+
+/**@brief     Function for requesting the peer to send data via Write Without Response.
+ *
+ * @details   Sends a single notification asking the peer to write byte_cnt bytes to the AMT Write
+ *            characteristic. The module sends @ref SERVICE_EVT_WRITE_STARTED on the first write and
+ *            @ref SERVICE_EVT_WRITE_FINISHED once byte_cnt bytes have been received.
+ *
+ * @param     p_ctx       Pointer to the AMTS structure.
+ * @param[in] byte_cnt    Number of bytes to request.
+ *
+ * @retval    NRF_SUCCESS  The request was queued. Otherwise an error code from sd_ble_gatts_hvx().
+ */
+ret_code_t nrf_ble_amts_write_request(nrf_ble_amts_t * p_ctx, uint32_t byte_cnt);
+
+
+/**@brief     Function for sending a notification built by the application, such as one received from another peer.
+ *
+ * @details   Uses the same TX buffer accounting as the module's own transfers. When no buffer is
+ *            free, wait for @ref SERVICE_EVT_TX_READY and try again.
+ *
+ * @param     p_ctx       Pointer to the AMTS structure.
+ * @param[in] p_data      Notification to send, copied by the SoftDevice.
+ * @param[in] len         Length of the notification.
+ *
+ * @retval    NRF_SUCCESS              The notification was queued.
+ * @retval    NRF_ERROR_BUSY           No TX buffer is free.
+ * @retval    NRF_ERROR_INVALID_STATE  Not connected, or a transfer of the module is running.
+ * @retval    NRF_ERROR_DATA_SIZE      The notification does not fit in the ATT MTU of the link.
+ *            Otherwise an error code from sd_ble_gatts_hvx().
+ */
+ret_code_t nrf_ble_amts_notif_forward(nrf_ble_amts_t * p_ctx, uint8_t const * p_data, uint16_t len);
+
+
 /**@brief     Function for setting the the number of received bytes.
  *
  * @details   Call this function to update the number of received bytes
@@ -291,7 +615,7 @@ void nrf_ble_amts_notif_spam(nrf_ble_amts_t * p_ctx);
  * @param     p_ctx    Pointer to the AMTS structure.
  * @param[in] byte_cnt number of received bytes.
  */
-void nrf_ble_amts_rbc_set(nrf_ble_amts_t * p_ctx, uint32_t byte_cnt);
+void nrf_ble_amts_rbc_set(nrf_ble_amts_t * p_ctx, uint64_t byte_cnt);
 
 
 /**@brief Function for handling the GATT module's events.
@@ -17,6 +17,7 @@
 #include "ble_gattc.h"
 #include "sdk_common.h"
 #include "amt.h"
+#include "counter.h"
 
 #define NRF_LOG_MODULE_NAME "AMTC"
 #include "nrf_log.h"
@@ -26,6 +27,11 @@
 
 #define WRITE_MESSAGE_LENGTH   BLE_CCCD_VALUE_LEN    /**< Length of the write message for CCCD. */
 
+#define OPCODE_LENGTH          1                     /**< Length of opcode inside a write. */
+#define HANDLE_LENGTH          2                     /**< Length of handle inside a write. */
+
+#define SEQ_RESTART_WINDOW     (64 * 1024)           /**< A notification starting this many bytes before the expected offset begins a new transfer. */
+
 typedef enum
 {
     READ_REQ,  /**< Type identifying that this tx_message is a read request. */
@@ -93,6 +99,125 @@ static void tx_buffer_process(void)
 }
 
 
+/**@brief     Function for adding the arrival of a notification to the statistics.
+ *
+ * @details   The jitter is the difference between consecutive inter-arrival times. It needs no
+ *            timestamps from the sender, which shares no clock with this device.
+ *
+ * @param     p_stats     Pointer to the statistics of the current transfer.
+ * @param[in] now         Arrival time in counter ticks.
+ */
+static void arrival_update(nrf_ble_amtc_arrival_stats_t * p_stats, uint64_t now)
+{
+    if (p_stats->first_ticks == 0)
+    {
+        p_stats->first_ticks = now;
+        p_stats->last_ticks  = now;
+        return;
+    }
+
+    uint32_t gap = (uint32_t)(now - p_stats->last_ticks);
+
+    if (p_stats->gap_cnt != 0)
+    {
+        p_stats->jitter_sum += (gap > p_stats->gap_last) ? (gap - p_stats->gap_last)
+                                                          : (p_stats->gap_last - gap);
+    }
+    if (gap > p_stats->gap_max)
+    {
+        p_stats->gap_max = gap;
+    }
+
+    p_stats->gap_cnt++;
+    p_stats->gap_last   = gap;
+    p_stats->last_ticks = now;
+}
+
+
+/**@brief     Function for clearing the statistics of the current transfer.
+ */
+static void transfer_reset(nrf_ble_amtc_t * p_ctx)
+{
+    p_ctx->bytes_rcvd_cnt = 0;
+    p_ctx->seq_ended      = false;
+    memset(&p_ctx->seq_stats, 0x00, sizeof(p_ctx->seq_stats));
+    memset(&p_ctx->arrival_stats, 0x00, sizeof(p_ctx->arrival_stats));
+}
+
+
+/**@brief     Function for deciding whether a notification belongs to a new transfer.
+ *
+ * @details   Does not wait for the first notification, which may be lost. A new transfer starts
+ *            after the end of the previous one, or, if that was lost too, when the offsets start
+ *            over well below the end of the previous one.
+ *
+ * @param[in] p_ctx       Pointer to the AMT Client structure.
+ * @param[in] offset      Offset decoded from the notification header.
+ * @param[in] len         Length of the notification.
+ */
+static bool transfer_start_is(nrf_ble_amtc_t const * p_ctx, uint32_t offset, uint16_t len)
+{
+    int32_t diff = (int32_t)((offset - len) - p_ctx->seq_stats.next_offset);
+
+    return (p_ctx->seq_ended || (offset == len) || (diff < -SEQ_RESTART_WINDOW));
+}
+
+
+/**@brief     Function for checking the offset of a received notification against the expected one.
+ *
+ * @details   The header holds the offset of the end of the notification, so the notification
+ *            covers [offset - len, offset). All arithmetic is modulo 2^32.
+ *
+ * @param     p_stats     Pointer to the statistics of the current transfer.
+ * @param[in] offset      Offset decoded from the notification header.
+ * @param[in] len         Length of the notification.
+ */
+static void seq_check(nrf_ble_amtc_seq_stats_t * p_stats, uint32_t offset, uint16_t len)
+{
+    uint32_t start = offset - len;
+    int32_t  diff  = (int32_t)(start - p_stats->next_offset);
+
+    if (diff == 0)
+    {
+        p_stats->goodput_bytes += len;
+        p_stats->next_offset    = offset;
+    }
+    else if (diff > 0)
+    {
+        // Data between the expected offset and this notification is missing, for now.
+        p_stats->gap_cnt++;
+        p_stats->lost_bytes    += (uint32_t)diff;
+        p_stats->gap_start      = p_stats->next_offset;
+        p_stats->gap_end        = start;
+        p_stats->goodput_bytes += len;
+        p_stats->next_offset    = offset;
+    }
+    else if (   ((int32_t)(start - p_stats->gap_start) >= 0)
+             && ((int32_t)(p_stats->gap_end - offset) >= 0)
+             && ((start == p_stats->gap_start) || (offset == p_stats->gap_end)))
+    {
+        // Arrived late at an edge of the most recent gap, which shrinks so that a copy of it is a
+        // duplicate. Without a record of the filled ranges, a hit in the middle is taken as one too.
+        p_stats->reorder_cnt++;
+        p_stats->lost_bytes     = (p_stats->lost_bytes > len) ? (p_stats->lost_bytes - len) : 0;
+        p_stats->goodput_bytes += len;
+
+        if (start == p_stats->gap_start)
+        {
+            p_stats->gap_start = offset;
+        }
+        else
+        {
+            p_stats->gap_end = start;
+        }
+    }
+    else
+    {
+        p_stats->dup_cnt++;
+    }
+}
+
+
 /**@brief     Function for handling Handle Value Notification received from the SoftDevice.
  *
  * @details   This function will uses the Handle Value Notification received from the SoftDevice
@@ -114,17 +239,105 @@ static void on_hvx(nrf_ble_amtc_t * p_ctx, const ble_evt_t * p_ble_evt)
     if (p_ble_evt->evt.gattc_evt.params.hvx.handle == p_ctx->peer_db.amt_handle)
     {
         nrf_ble_amtc_evt_t amt_c_evt;
-        p_ctx->bytes_rcvd_cnt           += p_ble_evt->evt.gattc_evt.params.hvx.len;
+        uint8_t            flags = (p_ble_evt->evt.gattc_evt.params.hvx.len >= AMT_NOTIF_HDR_LEN) ?
+                                   p_ble_evt->evt.gattc_evt.params.hvx.data[4] : 0;
+
+        amt_c_evt.conn_handle = p_ble_evt->evt.gattc_evt.conn_handle;
+
+        // Writes requested by this notification, or streamed back with it, carry the same payload.
+        p_ctx->write_payload_type = (flags & AMT_NOTIF_PAYLOAD_Msk) >> AMT_NOTIF_PAYLOAD_Pos;
+
+        // Confirm indications right away, the peer measures the round-trip time up to here.
+        if (p_ble_evt->evt.gattc_evt.params.hvx.type == BLE_GATT_HVX_INDICATION)
+        {
+            ret_code_t err_code = sd_ble_gattc_hv_confirm(p_ble_evt->evt.gattc_evt.conn_handle,
+                                                          p_ble_evt->evt.gattc_evt.params.hvx.handle);
+            if (err_code != NRF_SUCCESS)
+            {
+                NRF_LOG_ERROR("sd_ble_gattc_hv_confirm() failed: 0x%x\r\n", err_code);
+            }
+        }
+
+        // A write request carries no payload and is not counted as received data.
+        if (flags & AMT_NOTIF_FLAG_WRITE_REQ)
+        {
+            amt_c_evt.evt_type             = NRF_BLE_AMT_C_EVT_WRITE_REQ;
+            amt_c_evt.params.write_req_len = uint32_decode(p_ble_evt->evt.gattc_evt.params.hvx.data);
+            p_ctx->evt_handler(p_ctx, &amt_c_evt);
+            return;
+        }
+
+        uint64_t now    = counter_now();
+        uint16_t len    = p_ble_evt->evt.gattc_evt.params.hvx.len;
+        uint32_t offset = uint32_decode(p_ble_evt->evt.gattc_evt.params.hvx.data);
+
         amt_c_evt.evt_type              = NRF_BLE_AMT_C_EVT_NOTIFICATION;
-        amt_c_evt.conn_handle           = p_ble_evt->evt.gattc_evt.conn_handle;
-        amt_c_evt.params.hvx.notif_len  = p_ble_evt->evt.gattc_evt.params.hvx.len;
-        amt_c_evt.params.hvx.bytes_sent = uint32_decode(p_ble_evt->evt.gattc_evt.params.hvx.data);
+        amt_c_evt.params.hvx.bytes_sent = offset;
+        amt_c_evt.params.hvx.flags      = flags;
+        amt_c_evt.params.hvx.p_data     = p_ble_evt->evt.gattc_evt.params.hvx.data;
+        amt_c_evt.params.hvx.transfer_start = false;
+
+        // A header without payload ends a timed transfer, it carries no data.
+        if (len == AMT_NOTIF_HDR_LEN)
+        {
+            p_ctx->seq_ended                = ((flags & AMT_NOTIF_FLAG_LAST) != 0);
+            amt_c_evt.params.hvx.notif_len  = 0;
+            amt_c_evt.params.hvx.bytes_rcvd = p_ctx->bytes_rcvd_cnt;
+            p_ctx->evt_handler(p_ctx, &amt_c_evt);
+            return;
+        }
+
+        if (transfer_start_is(p_ctx, offset, len))
+        {
+            transfer_reset(p_ctx);
+            amt_c_evt.params.hvx.transfer_start = true;
+        }
+
+        // Older testers do not set the LAST flag, they are caught by transfer_start_is().
+        p_ctx->seq_ended = ((flags & AMT_NOTIF_FLAG_LAST) != 0);
+
+        seq_check(&p_ctx->seq_stats, offset, len);
+        arrival_update(&p_ctx->arrival_stats, now);
+
+        if (!nrf_ble_amt_payload_check(p_ble_evt->evt.gattc_evt.params.hvx.data, len,
+                           (flags & AMT_NOTIF_PAYLOAD_Msk) >> AMT_NOTIF_PAYLOAD_Pos))
+        {
+            p_ctx->seq_stats.corrupt_cnt++;
+        }
+
+        p_ctx->bytes_rcvd_cnt           += len;
+        amt_c_evt.params.hvx.notif_len  = len;
         amt_c_evt.params.hvx.bytes_rcvd = p_ctx->bytes_rcvd_cnt;
         p_ctx->evt_handler(p_ctx, &amt_c_evt);
     }
 }
 
 
+/**@brief     Function for decoding the value of the Received Bytes Count characteristic.
+ *
+ * @details   Accepts both the versioned 64-bit format and the legacy 32-bit format.
+ *
+ * @param[in] p_data  Characteristic value.
+ * @param[in] len     Length of the characteristic value.
+ *
+ * @return    Number of bytes received by the peer.
+ */
+static uint64_t rbc_decode(uint8_t const * p_data, uint16_t len)
+{
+    if ((len == AMT_RCV_BYTES_CNT_MAX_LEN) && (p_data[0] == AMT_RCV_BYTES_CNT_VERSION))
+    {
+        return (uint64_t)uint32_decode(&p_data[1]) | ((uint64_t)uint32_decode(&p_data[5]) << 32);
+    }
+    else if (len == AMT_RCV_BYTES_CNT_LEGACY_LEN)
+    {
+        return uint32_decode(p_data);
+    }
+
+    NRF_LOG_ERROR("Unknown RBC format, length %u.\r\n", len);
+    return 0;
+}
+
+
 /**@brief     Function for handling read response event received from the SoftDevice.
  *
  * @details   This function will uses the read response received from the SoftDevice
@@ -148,7 +361,8 @@ static void on_read_response(nrf_ble_amtc_t * p_ctx, const ble_evt_t * p_ble_evt
         nrf_ble_amtc_evt_t amt_c_evt;
         amt_c_evt.evt_type             = NRF_BLE_AMT_C_EVT_RBC_READ_RSP;
         amt_c_evt.conn_handle          = p_ble_evt->evt.gattc_evt.conn_handle;
-        amt_c_evt.params.rcv_bytes_cnt = uint32_decode(p_ble_evt->evt.gattc_evt.params.read_rsp.data);
+        amt_c_evt.params.rcv_bytes_cnt = rbc_decode(p_ble_evt->evt.gattc_evt.params.read_rsp.data,
+                                                    p_ble_evt->evt.gattc_evt.params.read_rsp.len);
         p_ctx->evt_handler(p_ctx, &amt_c_evt);
     }
 }
@@ -191,6 +405,9 @@ void nrf_ble_amtc_on_db_disc_evt(nrf_ble_amtc_t * p_ctx, const ble_db_discovery_
     nrf_ble_amtc_evt_t evt;
     evt.conn_handle = p_evt->conn_handle;
 
+    // Peers running older firmware do not have the Write characteristic.
+    evt.params.peer_db.amt_write_handle = BLE_GATT_HANDLE_INVALID;
+
     // Find the CCCD Handle of the AMT characteristic.
     for (uint32_t i = 0; i < p_evt->params.discovered_db.char_count; i++)
     {
@@ -211,6 +428,13 @@ void nrf_ble_amtc_on_db_disc_evt(nrf_ble_amtc_t * p_ctx, const ble_db_discovery_
             evt.params.peer_db.amt_rbc_handle      =
                 p_evt->params.discovered_db.charateristics[i].characteristic.handle_value;
         }
+
+        if ((uuid.uuid == AMT_WRITE_CHAR_UUID) && (uuid.type == p_ctx->uuid_type))
+        {
+            // Found AMT Write characteristic. Store handles.
+            evt.params.peer_db.amt_write_handle    =
+                p_evt->params.discovered_db.charateristics[i].characteristic.handle_value;
+        }
     }
 
     NRF_LOG_DEBUG("AMT Service discovered at peer.\r\n");
@@ -225,7 +449,7 @@ void nrf_ble_amtc_on_db_disc_evt(nrf_ble_amtc_t * p_ctx, const ble_db_discovery_
         }
     }
 
-    p_ctx->bytes_rcvd_cnt = 0;
+    transfer_reset(p_ctx);
 
     evt.evt_type = NRF_BLE_AMT_C_EVT_DISCOVERY_COMPLETE;
     p_ctx->evt_handler(p_ctx, &evt);
@@ -253,6 +477,10 @@ ret_code_t nrf_ble_amtc_init(nrf_ble_amtc_t * p_ctx, nrf_ble_amtc_evt_handler_t
     p_ctx->peer_db.amt_handle           = BLE_GATT_HANDLE_INVALID;
     p_ctx->conn_handle                  = BLE_CONN_HANDLE_INVALID;
     p_ctx->peer_db.amt_rbc_handle       = BLE_GATT_HANDLE_INVALID;
+    p_ctx->peer_db.amt_write_handle     = BLE_GATT_HANDLE_INVALID;
+    p_ctx->max_payload_len              = BLE_GATT_ATT_MTU_DEFAULT - OPCODE_LENGTH - HANDLE_LENGTH;
+    p_ctx->writing                      = false;
+    p_ctx->write_payload_type           = AMT_PAYLOAD_NONE;
 
     return ble_db_discovery_evt_register(&amt_uuid);
 }
@@ -273,6 +501,117 @@ ret_code_t nrf_ble_amtc_handles_assign(nrf_ble_amtc_t   * p_ctx,
 }
 
 
+/**@brief     Function for queuing Write Without Response to the peer while there are free TX buffers.
+ *
+ * @param[in] p_ctx       Pointer to the AMT Client structure.
+ */
+static void write_send(nrf_ble_amtc_t * p_ctx)
+{
+    uint8_t * data = p_ctx->write_buf;
+
+    ble_gattc_write_params_t write_params =
+    {
+        .write_op = BLE_GATT_OP_WRITE_CMD,
+        .handle   = p_ctx->peer_db.amt_write_handle,
+        .offset   = 0,
+        .len      = p_ctx->max_payload_len,
+        .p_value  = data,
+    };
+
+    while (p_ctx->writing && (p_ctx->tx_credits > 0))
+    {
+        data[4]          = 0;
+        write_params.len = p_ctx->max_payload_len;
+
+        // The last write of a bounded transfer only carries the remaining bytes.
+        if (p_ctx->write_limit != 0)
+        {
+            uint64_t remaining = p_ctx->write_limit - p_ctx->bytes_written;
+
+            if (remaining <= p_ctx->max_payload_len)
+            {
+                write_params.len = (uint16_t)remaining;
+                data[4]          = AMT_NOTIF_FLAG_LAST;
+            }
+            else if (remaining < (uint64_t)p_ctx->max_payload_len + AMT_NOTIF_HDR_LEN)
+            {
+                // Leave at least a whole header for the last write.
+                write_params.len = (uint16_t)(remaining - AMT_NOTIF_HDR_LEN);
+            }
+        }
+
+        (void) uint32_encode((uint32_t)(p_ctx->bytes_written + write_params.len), data);
+        data[4] |= (p_ctx->write_payload_type << AMT_NOTIF_PAYLOAD_Pos) & AMT_NOTIF_PAYLOAD_Msk;
+
+        // The shorter last write gets its trailer at its own end, the buffer is rebuilt at the next start.
+        if (p_ctx->write_payload_type == AMT_PAYLOAD_FIXED_CRC32)
+        {
+            nrf_ble_amt_payload_seal(p_ctx->write_payload_type, data, write_params.len);
+        }
+
+        uint32_t err_code = sd_ble_gattc_write(p_ctx->conn_handle, &write_params);
+
+        if (err_code == BLE_ERROR_NO_TX_PACKETS)
+        {
+            // Out of sync with the SoftDevice, wait for BLE_EVT_TX_COMPLETE.
+            p_ctx->tx_credits = 0;
+            break;
+        }
+        else if (err_code != NRF_SUCCESS)
+        {
+            NRF_LOG_ERROR("sd_ble_gattc_write() failed: 0x%x\r\n", err_code);
+            break;
+        }
+
+        p_ctx->tx_credits--;
+        p_ctx->tx_pending++;
+        p_ctx->bytes_written += write_params.len;
+
+        if (data[4] & AMT_NOTIF_FLAG_LAST)
+        {
+            p_ctx->writing = false;
+        }
+    }
+}
+
+
+/**@brief     Function for handling the TX_COMPLETE event.
+ *
+ * @param[in] p_ctx       Pointer to the AMT Client structure.
+ * @param[in] p_ble_evt   Pointer to the BLE event received.
+ */
+static void on_tx_complete(nrf_ble_amtc_t * p_ctx, ble_evt_t const * p_ble_evt)
+{
+    if (p_ctx->conn_handle != p_ble_evt->evt.common_evt.conn_handle)
+    {
+        return;
+    }
+
+    uint8_t count = p_ble_evt->evt.common_evt.params.tx_complete.count;
+
+    // The count covers all packets of the link, also the notifications of the AMT server.
+    p_ctx->tx_credits  = (uint8_t)MIN((uint16_t)p_ctx->tx_credits + count, p_ctx->tx_credits_max);
+    p_ctx->tx_pending  = (count < p_ctx->tx_pending) ? (p_ctx->tx_pending - count) : 0;
+
+    if (p_ctx->writing)
+    {
+        write_send(p_ctx);
+    }
+    else if ((p_ctx->write_limit != 0) && (p_ctx->tx_pending == 0))
+    {
+        // All writes of the bounded transfer have been completed by the SoftDevice.
+        nrf_ble_amtc_evt_t evt;
+
+        evt.evt_type             = NRF_BLE_AMT_C_EVT_WRITE_COMPLETE;
+        evt.conn_handle          = p_ctx->conn_handle;
+        evt.params.bytes_written = p_ctx->bytes_written;
+
+        p_ctx->write_limit = 0;
+        p_ctx->evt_handler(p_ctx, &evt);
+    }
+}
+
+
 /**@brief     Function for handling Disconnected event received from the SoftDevice.
  *
  * @details   This function check if the disconnect event is happening on the link
@@ -293,7 +632,14 @@ static void on_disconnected(nrf_ble_amtc_t * p_ctx, ble_evt_t const * p_ble_evt)
     p_ctx->peer_db.amt_cccd_handle = BLE_GATT_HANDLE_INVALID;
     p_ctx->peer_db.amt_handle      = BLE_GATT_HANDLE_INVALID;
     p_ctx->peer_db.amt_rbc_handle  = BLE_GATT_HANDLE_INVALID;
-    p_ctx->bytes_rcvd_cnt          = 0;
+    p_ctx->peer_db.amt_write_handle = BLE_GATT_HANDLE_INVALID;
+    p_ctx->writing                 = false;
+    p_ctx->tx_credits              = 0;
+    p_ctx->tx_credits_max          = 0;
+    p_ctx->tx_pending              = 0;
+    p_ctx->write_limit             = 0;
+
+    transfer_reset(p_ctx);
 }
 
 
@@ -322,6 +668,10 @@ void nrf_ble_amtc_on_ble_evt(nrf_ble_amtc_t * p_ctx, ble_evt_t const * p_ble_evt
             on_read_response(p_ctx, p_ble_evt);
             break;
 
+        case BLE_EVT_TX_COMPLETE:
+            on_tx_complete(p_ctx, p_ble_evt);
+            break;
+
         default:
             break;
     }
@@ -344,7 +694,8 @@ static ret_code_t cccd_configure(uint16_t conn_handle, uint16_t handle_cccd, boo
         handle_cccd, conn_handle);
 
     tx_message_t * p_msg;
-    uint16_t       cccd_val = enable ? BLE_GATT_HVX_NOTIFICATION : 0;
+    // Enable both, the peer decides per transfer whether to notify or indicate.
+    uint16_t       cccd_val = enable ? (BLE_GATT_HVX_NOTIFICATION | BLE_GATT_HVX_INDICATION) : 0;
 
     p_msg              = &m_tx_buffer[m_tx_insert_index++];
     m_tx_insert_index &= TX_BUFFER_MASK;
@@ -401,6 +752,55 @@ ret_code_t nrf_ble_amtc_rcb_read(nrf_ble_amtc_t * p_ctx)
     return NRF_SUCCESS;
 }
 
+
+ret_code_t nrf_ble_amtc_write_spam_start(nrf_ble_amtc_t * p_ctx, uint64_t byte_cnt)
+{
+    VERIFY_PARAM_NOT_NULL(p_ctx);
+
+    if (   (p_ctx->conn_handle == BLE_CONN_HANDLE_INVALID)
+        || (p_ctx->peer_db.amt_write_handle == BLE_GATT_HANDLE_INVALID))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    // Buffers still in use are reclaimed through BLE_ERROR_NO_TX_PACKETS and TX_COMPLETE.
+    ret_code_t err_code = sd_ble_tx_packet_count_get(p_ctx->conn_handle, &p_ctx->tx_credits);
+    VERIFY_SUCCESS(err_code);
+    p_ctx->tx_credits_max = p_ctx->tx_credits;
+
+    NRF_LOG_DEBUG("Starting Write Without Response stream.\r\n");
+
+    // The payload does not depend on the offset, fill it once.
+    nrf_ble_amt_payload_fill(p_ctx->write_payload_type, p_ctx->write_buf, p_ctx->max_payload_len);
+
+    // Every write carries a header, so a bounded transfer is at least one header long.
+    if ((byte_cnt != 0) && (byte_cnt < AMT_NOTIF_HDR_LEN))
+    {
+        byte_cnt = AMT_NOTIF_HDR_LEN;
+    }
+
+    p_ctx->bytes_written = 0;
+    p_ctx->tx_pending    = 0;
+    p_ctx->write_limit   = byte_cnt;
+    p_ctx->writing       = true;
+    write_send(p_ctx);
+
+    return NRF_SUCCESS;
+}
+
+
+void nrf_ble_amtc_write_spam_stop(nrf_ble_amtc_t * p_ctx)
+{
+    p_ctx->writing     = false;
+    p_ctx->write_limit = 0;
+}
+
+
+void nrf_ble_amtc_on_gatt_evt(nrf_ble_amtc_t * p_ctx, nrf_ble_gatt_evt_t * p_gatt_evt)
+{
+    p_ctx->max_payload_len = p_gatt_evt->att_mtu_effective - OPCODE_LENGTH - HANDLE_LENGTH;
+}
+
 /** @}
  *  @endcond
  */
@@ -14,6 +14,7 @@
 #include "ble_srv_common.h"
 #include "app_error.h"
 #include "amt.h"
+#include "counter.h"
 
 #define NRF_LOG_MODULE_NAME "AMTS"
 #include "nrf_log.h"
@@ -22,9 +23,11 @@
 #define OPCODE_LENGTH 1     /**< Length of opcode inside a notification. */
 #define HANDLE_LENGTH 2     /**< Length of handle inside a notification. */
 
-uint32_t amt_byte_transfer_count;
+uint64_t amt_byte_transfer_count;
 
 static void char_notification_send(nrf_ble_amts_t * p_ctx);
+static void char_indication_send(nrf_ble_amts_t * p_ctx);
+static void notif_buf_build(nrf_ble_amts_t * p_ctx);
 
 
 /**@brief Function for handling the Connect event.
@@ -35,6 +38,15 @@ static void char_notification_send(nrf_ble_amts_t * p_ctx);
 static void on_connect(nrf_ble_amts_t * p_ctx, ble_evt_t * p_ble_evt)
 {
     p_ctx->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+
+    // All TX buffers are free at connection, query how many the SoftDevice gives us.
+    ret_code_t err_code = sd_ble_tx_packet_count_get(p_ctx->conn_handle, &p_ctx->tx_credits);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("sd_ble_tx_packet_count_get() failed: 0x%x\r\n", err_code);
+        p_ctx->tx_credits = 1;
+    }
+    p_ctx->tx_credits_max = p_ctx->tx_credits;
 }
 
 
@@ -46,20 +58,211 @@ static void on_connect(nrf_ble_amts_t * p_ctx, ble_evt_t * p_ble_evt)
 static void on_disconnect(nrf_ble_amts_t * p_ctx, ble_evt_t * p_ble_evt)
 {
     p_ctx->conn_handle = BLE_CONN_HANDLE_INVALID;
+    p_ctx->busy           = false;
+    p_ctx->tx_credits     = 0;
+    p_ctx->tx_credits_max = 0;
+    p_ctx->write_expected = 0;
+    p_ctx->hvc_pending    = false;
+}
+
+
+/**@brief Function for adding the packet count of one TX_COMPLETE event to the statistics.
+ *
+ * @param     p_stats     Pointer to the statistics structure.
+ * @param[in] count       Number of packets completed in the event.
+ */
+static void tx_stats_update(nrf_ble_amts_tx_stats_t * p_stats, uint8_t count)
+{
+    if ((p_stats->evt_cnt == 0) || (count < p_stats->min))
+    {
+        p_stats->min = count;
+    }
+    if (count > p_stats->max)
+    {
+        p_stats->max = count;
+    }
+
+    p_stats->evt_cnt++;
+    p_stats->pkt_cnt += count;
+
+    if (count >= AMTS_TX_COMPLETE_HIST_SIZE)
+    {
+        count = AMTS_TX_COMPLETE_HIST_SIZE - 1;
+    }
+    p_stats->hist[count]++;
+}
+
+
+/**@brief Function for starting a new set of byte milestones.
+ */
+static void milestones_reset(nrf_ble_amts_milestones_t * p_ms)
+{
+    p_ms->cnt       = 0;
+    p_ms->step      = AMTS_MILESTONE_STEP_MIN;
+    p_ms->delivered = 0;
+}
+
+
+/**@brief Function for adding delivered bytes and taking a milestone when the next one is due.
+ */
+static void milestones_update(nrf_ble_amts_milestones_t * p_ms, uint32_t len)
+{
+    p_ms->delivered += len;
+
+    if (p_ms->delivered < (p_ms->cnt * p_ms->step))
+    {
+        return;
+    }
+
+    if (p_ms->cnt == AMTS_MILESTONE_CNT)
+    {
+        // Keep the even milestones, they are the multiples of the doubled step.
+        for (uint32_t i = 1; i < (AMTS_MILESTONE_CNT / 2); i++)
+        {
+            p_ms->bytes[i] = p_ms->bytes[2 * i];
+            p_ms->ticks[i] = p_ms->ticks[2 * i];
+        }
+
+        p_ms->cnt   = AMTS_MILESTONE_CNT / 2;
+        p_ms->step *= 2;
+
+        if (p_ms->delivered < (p_ms->cnt * p_ms->step))
+        {
+            return;
+        }
+    }
+
+    p_ms->bytes[p_ms->cnt] = p_ms->delivered;
+    p_ms->ticks[p_ms->cnt] = counter_now();
+    p_ms->cnt++;
 }
 
 
 /**@brief Function for handling the TX_COMPLETE event.
+ *
+ * @details Every completed packet frees one TX buffer, so the credits are refilled by the
+ *          number of packets reported in the event before queuing more notifications.
  *
  * @param     p_ctx       Pointer to the AMTS structure.
+ * @param[in] p_ble_evt   Event received from the BLE stack.
  */
-static void on_tx_complete(nrf_ble_amts_t * p_ctx)
+static void on_tx_complete(nrf_ble_amts_t * p_ctx, ble_evt_t * p_ble_evt)
 {
-    if (p_ctx->busy)
+    if (p_ble_evt->evt.common_evt.conn_handle != p_ctx->conn_handle)
     {
-        p_ctx->busy = false;
+        return;
+    }
+
+    uint8_t count     = p_ble_evt->evt.common_evt.params.tx_complete.count;
+    bool    was_empty = (p_ctx->tx_credits == 0);
+
+    // The count covers all packets of the link, also the writes of the AMT client. The
+    // buffers cannot be told apart, so never count more than the link has.
+    p_ctx->tx_credits = (uint8_t)MIN((uint16_t)p_ctx->tx_credits + count, p_ctx->tx_credits_max);
+
+    if (p_ctx->busy && !p_ctx->indicate)
+    {
+        tx_stats_update(&p_ctx->tx_stats, count);
+        milestones_update(&p_ctx->milestones, (uint32_t)count * p_ctx->notif_len);
         char_notification_send(p_ctx);
     }
+    else if (!p_ctx->busy && was_empty && (p_ctx->tx_credits > 0))
+    {
+        // The application may be forwarding notifications, let it fill the freed buffers.
+        nrf_ble_amts_evt_t evt;
+
+        evt.conn_handle          = p_ctx->conn_handle;
+        evt.evt_type             = SERVICE_EVT_TX_READY;
+        evt.bytes_transfered_cnt = 0;
+        p_ctx->evt_handler(evt);
+    }
+}
+
+
+/**@brief Function for getting the round-trip time histogram bin of a value.
+ *
+ * @details Values below AMTS_RTT_HIST_SUB_BINS get one bin each. Above that, every power of two
+ *          is split into AMTS_RTT_HIST_SUB_BINS bins using the bits below the most significant one.
+ */
+static uint32_t rtt_bin_get(uint32_t ticks)
+{
+    if (ticks < AMTS_RTT_HIST_SUB_BINS)
+    {
+        return ticks;
+    }
+
+    uint32_t msb = 31 - __CLZ(ticks);
+    uint32_t bin = ((msb - 2) * AMTS_RTT_HIST_SUB_BINS) + ((ticks >> (msb - 3)) & (AMTS_RTT_HIST_SUB_BINS - 1));
+
+    return MIN(bin, AMTS_RTT_HIST_SIZE - 1);
+}
+
+
+/**@brief Function for getting the largest value that falls into a round-trip time histogram bin.
+ */
+static uint32_t rtt_bin_max_get(uint32_t bin)
+{
+    if (bin < AMTS_RTT_HIST_SUB_BINS)
+    {
+        return bin;
+    }
+    if (bin == AMTS_RTT_HIST_SIZE - 1)
+    {
+        return UINT32_MAX;
+    }
+
+    uint32_t msb   = (bin / AMTS_RTT_HIST_SUB_BINS) + 2;
+    uint32_t lower = (AMTS_RTT_HIST_SUB_BINS + (bin % AMTS_RTT_HIST_SUB_BINS)) << (msb - 3);
+
+    return lower + (1UL << (msb - 3)) - 1;
+}
+
+
+/**@brief Function for adding one indication round-trip time to the statistics.
+ *
+ * @param     p_stats     Pointer to the statistics structure.
+ * @param[in] ticks       Round-trip time in counter ticks.
+ */
+static void rtt_stats_update(nrf_ble_amts_rtt_stats_t * p_stats, uint32_t ticks)
+{
+    if ((p_stats->cnt == 0) || (ticks < p_stats->min))
+    {
+        p_stats->min = ticks;
+    }
+    if (ticks > p_stats->max)
+    {
+        p_stats->max = ticks;
+    }
+
+    p_stats->cnt++;
+    p_stats->sum += ticks;
+    p_stats->hist[rtt_bin_get(ticks)]++;
+}
+
+
+/**@brief Function for handling the Handle Value Confirmation event.
+ *
+ * @param     p_ctx       Pointer to the AMTS structure.
+ * @param[in] p_ble_evt   Event received from the BLE stack.
+ */
+static void on_hvc(nrf_ble_amts_t * p_ctx, ble_evt_t * p_ble_evt)
+{
+    if (   (p_ble_evt->evt.gatts_evt.conn_handle != p_ctx->conn_handle)
+        || (p_ble_evt->evt.gatts_evt.params.hvc.handle != p_ctx->amts_char_handles.value_handle)
+        || !p_ctx->hvc_pending)
+    {
+        return;
+    }
+
+    p_ctx->hvc_pending = false;
+
+    // The end marker of a timed transfer is confirmed after the transfer has finished.
+    if (p_ctx->busy)
+    {
+        rtt_stats_update(&p_ctx->rtt_stats, (uint32_t)(counter_now() - p_ctx->hvx_ticks));
+        milestones_update(&p_ctx->milestones, p_ctx->notif_len);
+        char_indication_send(p_ctx);
+    }
 }
 
 
@@ -72,12 +275,56 @@ static void on_write(nrf_ble_amts_t * p_ctx, ble_evt_t * p_ble_evt)
 {
     ble_gatts_evt_write_t * p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
 
-    if ((p_evt_write->handle == p_ctx->amts_char_handles.cccd_handle) &&
-        (p_evt_write->len == 2))
+    if (p_evt_write->handle == p_ctx->amt_write_char_handles.value_handle)
+    {
+        p_ctx->bytes_rcvd += p_evt_write->len;
+
+        // Writes carry the same header and payload as the notifications.
+        if (   (p_evt_write->len > AMT_NOTIF_HDR_LEN)
+            && !nrf_ble_amt_payload_check(p_evt_write->data, p_evt_write->len,
+                                          (p_evt_write->data[4] & AMT_NOTIF_PAYLOAD_Msk) >> AMT_NOTIF_PAYLOAD_Pos))
+        {
+            p_ctx->write_corrupt_cnt++;
+        }
+
+        if (p_ctx->write_expected == 0)
+        {
+            return;
+        }
+
+        nrf_ble_amts_evt_t evt;
+
+        evt.conn_handle = p_ctx->conn_handle;
+
+        if (p_ctx->write_rcvd == 0)
+        {
+            milestones_reset(&p_ctx->milestones);
+
+            evt.evt_type             = SERVICE_EVT_WRITE_STARTED;
+            evt.bytes_transfered_cnt = 0;
+            p_ctx->evt_handler(evt);
+        }
+
+        p_ctx->write_rcvd += p_evt_write->len;
+        milestones_update(&p_ctx->milestones, p_evt_write->len);
+
+        if (p_ctx->write_rcvd >= p_ctx->write_expected)
+        {
+            p_ctx->write_expected = 0;
+
+            evt.evt_type             = SERVICE_EVT_WRITE_FINISHED;
+            evt.bytes_transfered_cnt = p_ctx->write_rcvd;
+            p_ctx->evt_handler(evt);
+        }
+    }
+    else if ((p_evt_write->handle == p_ctx->amts_char_handles.cccd_handle) &&
+             (p_evt_write->len == 2))
     {
         // CCCD written, call the application event handler.
         nrf_ble_amts_evt_t evt;
 
+        evt.conn_handle = p_ctx->conn_handle;
+
         if (ble_srv_is_notification_enabled(p_evt_write->data))
         {
             evt.evt_type = SERVICE_EVT_NOTIF_ENABLED;
@@ -109,7 +356,11 @@ void nrf_ble_amts_on_ble_evt(nrf_ble_amts_t * p_ctx, ble_evt_t * p_ble_evt)
             break;
 
         case BLE_EVT_TX_COMPLETE:
-            on_tx_complete(p_ctx);
+            on_tx_complete(p_ctx, p_ble_evt);
+            break;
+
+        case BLE_GATTS_EVT_HVC:
+            on_hvc(p_ctx, p_ble_evt);
             break;
 
         default:
@@ -141,12 +392,13 @@ void nrf_ble_amts_init(nrf_ble_amts_t * p_ctx, amts_evt_handler_t evt_handler)
     ble_add_char_params_t amt_params;
     memset(&amt_params, 0, sizeof(amt_params));
 
-    amt_params.uuid              = AMTS_CHAR_UUID;
-    amt_params.uuid_type         = p_ctx->uuid_type;
-    amt_params.max_len           = NRF_BLE_GATT_MAX_MTU_SIZE;
-    amt_params.char_props.notify = 1;
-    amt_params.cccd_write_access = SEC_OPEN;
-    amt_params.is_var_len        = 1;
+    amt_params.uuid                = AMTS_CHAR_UUID;
+    amt_params.uuid_type           = p_ctx->uuid_type;
+    amt_params.max_len             = NRF_BLE_GATT_MAX_MTU_SIZE;
+    amt_params.char_props.notify   = 1;
+    amt_params.char_props.indicate = 1;
+    amt_params.cccd_write_access   = SEC_OPEN;
+    amt_params.is_var_len          = 1;
 
     err_code = characteristic_add(service_handle, &amt_params, &(p_ctx->amts_char_handles));
     APP_ERROR_CHECK(err_code);
@@ -164,6 +416,20 @@ void nrf_ble_amts_init(nrf_ble_amts_t * p_ctx, amts_evt_handler_t evt_handler)
     err_code = characteristic_add(service_handle, &amt_rbc_params, &(p_ctx->amt_rbc_char_handles));
     APP_ERROR_CHECK(err_code);
 
+    // Add AMT Write characteristic, used for the peer to stream data back.
+    ble_add_char_params_t amt_write_params;
+    memset(&amt_write_params, 0, sizeof(amt_write_params));
+
+    amt_write_params.uuid                     = AMT_WRITE_CHAR_UUID;
+    amt_write_params.uuid_type                = p_ctx->uuid_type;
+    amt_write_params.max_len                  = NRF_BLE_GATT_MAX_MTU_SIZE;
+    amt_write_params.char_props.write_wo_resp = 1;
+    amt_write_params.write_access             = SEC_OPEN;
+    amt_write_params.is_var_len               = 1;
+
+    err_code = characteristic_add(service_handle, &amt_write_params, &(p_ctx->amt_write_char_handles));
+    APP_ERROR_CHECK(err_code);
+
     p_ctx->evt_handler = evt_handler;
 }
 
@@ -172,34 +438,148 @@ void nrf_ble_amts_notif_spam(nrf_ble_amts_t * p_ctx)
 {
     p_ctx->kbytes_sent = 0;
     p_ctx->bytes_sent  = 0;
-    char_notification_send(p_ctx);
+    p_ctx->write_corrupt_cnt = 0;
+    p_ctx->busy        = true;
+    p_ctx->stop_pending = false;
+    memset(&p_ctx->tx_stats, 0x00, sizeof(p_ctx->tx_stats));
+    memset(&p_ctx->rtt_stats, 0x00, sizeof(p_ctx->rtt_stats));
+    milestones_reset(&p_ctx->milestones);
+
+    if (   (p_ctx->notif_len != p_ctx->max_payload_len)
+        || (p_ctx->notif_buf_type != p_ctx->payload_type))
+    {
+        notif_buf_build(p_ctx);
+    }
+
+    p_ctx->hvx_params.type = p_ctx->indicate ? BLE_GATT_HVX_INDICATION : BLE_GATT_HVX_NOTIFICATION;
+
+    // Release the first notification right away, the rest as the bucket is refilled.
+    p_ctx->pace_ticks       = counter_now();
+    p_ctx->pace_credit      = (uint64_t)p_ctx->notif_len * COUNTER_FREQ_HZ;
+    p_ctx->pace_backlog_max = 0;
+
+    p_ctx->hdr_flags       = p_ctx->notif_flags
+                           | ((p_ctx->payload_type << AMT_NOTIF_PAYLOAD_Pos) & AMT_NOTIF_PAYLOAD_Msk)
+                           | ((p_ctx->pace_rate != 0) ? AMT_NOTIF_FLAG_PACED : 0)
+                           | (p_ctx->timed ? AMT_NOTIF_FLAG_TIMED : 0);
+
+    if (p_ctx->indicate)
+    {
+        char_indication_send(p_ctx);
+    }
+    else
+    {
+        char_notification_send(p_ctx);
+    }
 }
 
 
-void nrf_ble_amts_on_gatt_evt(nrf_ble_amts_t * p_ctx, nrf_ble_gatt_evt_t * p_gatt_evt)
+void nrf_ble_amts_pace_refill(nrf_ble_amts_t * p_ctx)
 {
-    p_ctx->max_payload_len = p_gatt_evt->att_mtu_effective - OPCODE_LENGTH - HANDLE_LENGTH;
+    if (!p_ctx->busy || p_ctx->indicate || (p_ctx->pace_rate == 0))
+    {
+        return;
+    }
+
+    uint64_t now = counter_now();
+
+    p_ctx->pace_credit += (now - p_ctx->pace_ticks) * p_ctx->pace_rate;
+    p_ctx->pace_ticks   = now;
+
+    uint32_t backlog = (uint32_t)(p_ctx->pace_credit / COUNTER_FREQ_HZ);
+    if (backlog > p_ctx->pace_backlog_max)
+    {
+        p_ctx->pace_backlog_max = backlog;
+    }
+
+    char_notification_send(p_ctx);
 }
 
 
-static void char_notification_send(nrf_ble_amts_t * p_ctx)
+ret_code_t nrf_ble_amts_steady_window_get(nrf_ble_amts_t const * p_ctx,
+                                          uint8_t                trim_percent,
+                                          uint64_t             * p_bytes,
+                                          uint64_t             * p_ticks)
 {
-    uint8_t            data[256];
-    uint16_t           len = p_ctx->max_payload_len;
-    nrf_ble_amts_evt_t evt;
+    nrf_ble_amts_milestones_t const * p_ms = &p_ctx->milestones;
 
-    if (p_ctx->bytes_sent >= amt_byte_transfer_count)
+    uint64_t lo    = (p_ms->delivered * trim_percent) / 100;
+    uint64_t hi    = p_ms->delivered - lo;
+    uint32_t first = 0;
+    uint32_t last;
+
+    while ((first < p_ms->cnt) && (p_ms->bytes[first] < lo))
     {
-        evt.bytes_transfered_cnt = p_ctx->bytes_sent;
-        p_ctx->busy              = false;
-        p_ctx->bytes_sent        = 0;
-        p_ctx->kbytes_sent       = 0;
+        first++;
+    }
 
-        evt.evt_type = SERVICE_EVT_TRANSFER_FINISHED;
-        p_ctx->evt_handler(evt);
+    for (last = p_ms->cnt; (last > first) && (p_ms->bytes[last - 1] > hi); last--)
+    {
+        // Find the milestone after the last one in the window.
+    }
+
+    // Two milestones are needed to measure a rate.
+    if (last < first + 2)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    *p_bytes = p_ms->bytes[last - 1] - p_ms->bytes[first];
+    *p_ticks = p_ms->ticks[last - 1] - p_ms->ticks[first];
+
+    return NRF_SUCCESS;
+}
+
+
+void nrf_ble_amts_transfer_stop(nrf_ble_amts_t * p_ctx)
+{
+    if (!p_ctx->busy || p_ctx->stop_pending)
+    {
         return;
     }
 
+    p_ctx->stop_pending = true;
+
+    // Only count what has been acknowledged by the deadline: TX_COMPLETE for notifications,
+    // the confirmation for indications. The TX_COMPLETE count also covers the AMT client's
+    // writes on the same link, so it is capped at what was queued.
+    p_ctx->stop_delivered = MIN(p_ctx->milestones.delivered, p_ctx->bytes_sent);
+
+    if (p_ctx->indicate)
+    {
+        char_indication_send(p_ctx);
+    }
+    else
+    {
+        char_notification_send(p_ctx);
+    }
+}
+
+
+uint32_t nrf_ble_amts_rtt_percentile_get(nrf_ble_amts_rtt_stats_t const * p_stats, uint8_t percent)
+{
+    // Rank of the sample holding the percentile, rounded up.
+    uint32_t rank = (uint32_t)(((uint64_t)p_stats->cnt * percent + 99) / 100);
+    uint32_t seen = 0;
+
+    for (uint32_t i = 0; i < AMTS_RTT_HIST_SIZE; i++)
+    {
+        seen += p_stats->hist[i];
+        if ((seen != 0) && (seen >= rank))
+        {
+            return MIN(rtt_bin_max_get(i), p_stats->max);
+        }
+    }
+
+    return 0;
+}
+
+
+ret_code_t nrf_ble_amts_write_request(nrf_ble_amts_t * p_ctx, uint32_t byte_cnt)
+{
+    uint8_t  data[AMT_NOTIF_HDR_LEN];
+    uint16_t len = sizeof(data);
+
     ble_gatts_hvx_params_t const hvx_param =
     {
         .type   = BLE_GATT_HVX_NOTIFICATION,
@@ -208,48 +588,333 @@ static void char_notification_send(nrf_ble_amts_t * p_ctx)
         .p_len  = &len,
     };
 
-	p_ctx->bytes_sent += len;
+    (void) uint32_encode(byte_cnt, data);
+    data[4] = AMT_NOTIF_FLAG_WRITE_REQ | ((p_ctx->payload_type << AMT_NOTIF_PAYLOAD_Pos) & AMT_NOTIF_PAYLOAD_Msk);
 
-	if (p_ctx->kbytes_sent != (p_ctx->bytes_sent / 1024))
-	{
-		p_ctx->kbytes_sent = (p_ctx->bytes_sent / 1024);
+    p_ctx->write_expected    = byte_cnt;
+    p_ctx->write_rcvd        = 0;
+    p_ctx->write_corrupt_cnt = 0;
 
-		evt.evt_type             = SERVICE_EVT_TRANSFER_1KB;
-		evt.bytes_transfered_cnt = p_ctx->bytes_sent;
-		p_ctx->evt_handler(evt);
-	}
-	
-    uint32_t err_code = NRF_SUCCESS;
-    while (err_code == NRF_SUCCESS)
+    ret_code_t err_code = sd_ble_gatts_hvx(p_ctx->conn_handle, &hvx_param);
+    if (err_code != NRF_SUCCESS)
+    {
+        p_ctx->write_expected = 0;
+        return err_code;
+    }
+
+    if (p_ctx->tx_credits > 0)
     {
-        (void) uint32_encode(p_ctx->bytes_sent, data);
+        p_ctx->tx_credits--;
+    }
+
+    return NRF_SUCCESS;
+}
+
 
-        err_code = sd_ble_gatts_hvx(p_ctx->conn_handle, &hvx_param);
+ret_code_t nrf_ble_amts_notif_forward(nrf_ble_amts_t * p_ctx, uint8_t const * p_data, uint16_t len)
+{
+    if ((p_ctx->conn_handle == BLE_CONN_HANDLE_INVALID) || p_ctx->busy)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    if (len > p_ctx->max_payload_len)
+    {
+        return NRF_ERROR_DATA_SIZE;
+    }
+
+    if (p_ctx->tx_credits == 0)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    ble_gatts_hvx_params_t const hvx_param =
+    {
+        .type   = BLE_GATT_HVX_NOTIFICATION,
+        .handle = p_ctx->amts_char_handles.value_handle,
+        .p_data = p_data,
+        .p_len  = &len,
+    };
+
+    ret_code_t err_code = sd_ble_gatts_hvx(p_ctx->conn_handle, &hvx_param);
+    if (err_code == BLE_ERROR_NO_TX_PACKETS)
+    {
+        // Out of sync with the SoftDevice, wait for BLE_EVT_TX_COMPLETE.
+        p_ctx->tx_credits = 0;
+        return NRF_ERROR_BUSY;
+    }
+    else if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    p_ctx->tx_credits--;
+
+    return NRF_SUCCESS;
+}
+
+
+void nrf_ble_amts_on_gatt_evt(nrf_ble_amts_t * p_ctx, nrf_ble_gatt_evt_t * p_gatt_evt)
+{
+    p_ctx->max_payload_len = p_gatt_evt->att_mtu_effective - OPCODE_LENGTH - HANDLE_LENGTH;
+}
+
+
+/**@brief Function for ending the transfer and notifying the application.
+ */
+static void transfer_finished(nrf_ble_amts_t * p_ctx)
+{
+    nrf_ble_amts_evt_t evt;
+
+    evt.conn_handle          = p_ctx->conn_handle;
+    evt.bytes_transfered_cnt = p_ctx->timed ? p_ctx->stop_delivered : p_ctx->bytes_sent;
+    p_ctx->busy              = false;
+    p_ctx->bytes_sent        = 0;
+    p_ctx->kbytes_sent       = 0;
+
+    evt.evt_type = SERVICE_EVT_TRANSFER_FINISHED;
+    p_ctx->evt_handler(evt);
+}
+
+
+/**@brief Function for checking whether all data of a byte count transfer has been queued.
+ *
+ * @details Timed transfers only end with nrf_ble_amts_transfer_stop().
+ */
+static bool transfer_done(nrf_ble_amts_t const * p_ctx)
+{
+    return (!p_ctx->timed && (p_ctx->bytes_sent >= amt_byte_transfer_count));
+}
+
+
+/**@brief Function for sending the header that ends a timed transfer, then finishing the transfer.
+ *
+ * @details The header carries the number of bytes sent and no payload. If the SoftDevice has no
+ *          free buffer it is sent again from the next BLE_EVT_TX_COMPLETE.
+ *
+ * @param     p_ctx       Pointer to the AMTS structure.
+ */
+static void end_marker_send(nrf_ble_amts_t * p_ctx)
+{
+    uint8_t  data[AMT_NOTIF_HDR_LEN];
+    uint16_t len = sizeof(data);
+
+    ble_gatts_hvx_params_t const hvx_param =
+    {
+        .type   = p_ctx->hvx_params.type,
+        .handle = p_ctx->amts_char_handles.value_handle,
+        .p_data = data,
+        .p_len  = &len,
+    };
+
+    if (!p_ctx->indicate && (p_ctx->tx_credits == 0))
+    {
+        return;
+    }
+
+    (void) uint32_encode((uint32_t)p_ctx->bytes_sent, data);
+    data[4] = p_ctx->hdr_flags | AMT_NOTIF_FLAG_LAST;
+
+    uint32_t err_code = sd_ble_gatts_hvx(p_ctx->conn_handle, &hvx_param);
+
+    if (err_code == BLE_ERROR_NO_TX_PACKETS)
+    {
+        p_ctx->tx_credits = 0;
+        return;
+    }
+    else if (err_code != NRF_SUCCESS)
+    {
+        // Finish anyway, the peer only misses its summary.
+        NRF_LOG_ERROR("sd_ble_gatts_hvx() failed: 0x%x\r\n", err_code);
+    }
+    else if (p_ctx->indicate)
+    {
+        p_ctx->hvc_pending = true;
+    }
+    else
+    {
+        p_ctx->tx_credits--;
+    }
+
+    p_ctx->stop_pending = false;
+    transfer_finished(p_ctx);
+}
+
+
+/**@brief Function for updating the sent byte count and sending the 1 KB event when due.
+ */
+static void bytes_sent_add(nrf_ble_amts_t * p_ctx, uint16_t len)
+{
+    p_ctx->bytes_sent += len;
+
+    if (p_ctx->kbytes_sent != (p_ctx->bytes_sent / 1024))
+    {
+        nrf_ble_amts_evt_t evt;
+
+        evt.conn_handle = p_ctx->conn_handle;
+
+        p_ctx->kbytes_sent = (p_ctx->bytes_sent / 1024);
+
+        evt.evt_type             = SERVICE_EVT_TRANSFER_1KB;
+        evt.bytes_transfered_cnt = p_ctx->bytes_sent;
+        p_ctx->evt_handler(evt);
+    }
+}
+
+
+/**@brief Function for building the notification buffer and the sd_ble_gatts_hvx() parameters.
+ *
+ * @details The payload only depends on its type and length, so this is only needed when either
+ *          changes, i.e. after an ATT MTU exchange or when the application picks another payload.
+ *
+ * @param     p_ctx       Pointer to the AMTS structure.
+ */
+static void notif_buf_build(nrf_ble_amts_t * p_ctx)
+{
+    p_ctx->notif_len      = p_ctx->max_payload_len;
+    p_ctx->notif_buf_type = p_ctx->payload_type;
+
+    nrf_ble_amt_payload_fill(p_ctx->notif_buf_type, p_ctx->notif_buf, p_ctx->notif_len);
+
+    p_ctx->hvx_params.handle = p_ctx->amts_char_handles.value_handle;
+    p_ctx->hvx_params.offset = 0;
+    p_ctx->hvx_params.p_data = p_ctx->notif_buf;
+    p_ctx->hvx_params.p_len  = &p_ctx->hvx_len;
+}
+
+
+/**@brief Function for writing the header of the next notification of the transfer.
+ *
+ * @details This is the only per-packet work on the buffer, apart from the CRC trailer of
+ *          @ref AMT_PAYLOAD_FIXED_CRC32 payloads.
+ *
+ * @param     p_ctx       Pointer to the AMTS structure.
+ */
+static void notif_header_set(nrf_ble_amts_t * p_ctx)
+{
+    uint64_t end = p_ctx->bytes_sent + p_ctx->notif_len;
+
+    (void) uint32_encode((uint32_t)end, p_ctx->notif_buf);
+    p_ctx->notif_buf[4] = (!p_ctx->timed && (end >= amt_byte_transfer_count)) ? (p_ctx->hdr_flags | AMT_NOTIF_FLAG_LAST)
+                                                                               : p_ctx->hdr_flags;
+
+    if (p_ctx->notif_buf_type == AMT_PAYLOAD_FIXED_CRC32)
+    {
+        nrf_ble_amt_payload_seal(p_ctx->notif_buf_type, p_ctx->notif_buf, p_ctx->notif_len);
+    }
+
+    // sd_ble_gatts_hvx() writes back the number of bytes it queued.
+    p_ctx->hvx_len = p_ctx->notif_len;
+}
+
+
+/**@brief Function for sending the next indication of the transfer.
+ *
+ * @details Only one indication is outstanding at a time. The next one is sent from the
+ *          BLE_GATTS_EVT_HVC handler, and the transfer finishes when the last one is confirmed.
+ */
+static void char_indication_send(nrf_ble_amts_t * p_ctx)
+{
+    if (p_ctx->hvc_pending)
+    {
+        return;
+    }
+
+    if (p_ctx->stop_pending)
+    {
+        end_marker_send(p_ctx);
+        return;
+    }
+
+    if (transfer_done(p_ctx))
+    {
+        transfer_finished(p_ctx);
+        return;
+    }
+
+    notif_header_set(p_ctx);
+
+    uint64_t hvx_ticks = counter_now();
+    uint32_t err_code  = sd_ble_gatts_hvx(p_ctx->conn_handle, &p_ctx->hvx_params);
+
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("sd_ble_gatts_hvx() failed: 0x%x\r\n", err_code);
+        return;
+    }
+
+    p_ctx->hvc_pending = true;
+    p_ctx->hvx_ticks   = hvx_ticks;
+    bytes_sent_add(p_ctx, p_ctx->notif_len);
+}
+
+
+static void char_notification_send(nrf_ble_amts_t * p_ctx)
+{
+    if (p_ctx->stop_pending)
+    {
+        end_marker_send(p_ctx);
+        return;
+    }
+
+    if (transfer_done(p_ctx))
+    {
+        transfer_finished(p_ctx);
+        return;
+    }
+
+    // Only queue as many notifications as there are free TX buffers, so that
+    // sd_ble_gatts_hvx() is never called when it is known to fail.
+    uint64_t const pkt_credit = (uint64_t)p_ctx->notif_len * COUNTER_FREQ_HZ;
+
+    while ((p_ctx->tx_credits > 0) && !transfer_done(p_ctx))
+    {
+        // Paced transfers wait for the token bucket to release a full notification.
+        if ((p_ctx->pace_rate != 0) && (p_ctx->pace_credit < pkt_credit))
+        {
+            break;
+        }
+
+        notif_header_set(p_ctx);
+
+        uint32_t err_code = sd_ble_gatts_hvx(p_ctx->conn_handle, &p_ctx->hvx_params);
 
         if (err_code == BLE_ERROR_NO_TX_PACKETS)
         {
-            // Wait for BLE_EVT_TX_COMPLETE.
-            p_ctx->busy = true;
+            // Out of sync with the SoftDevice, wait for BLE_EVT_TX_COMPLETE.
+            p_ctx->tx_credits = 0;
             break;
         }
         else if (err_code != NRF_SUCCESS)
         {
             NRF_LOG_ERROR("sd_ble_gatts_hvx() failed: 0x%x\r\n", err_code);
+            break;
         }
+
+        p_ctx->tx_credits--;
+        if (p_ctx->pace_rate != 0)
+        {
+            p_ctx->pace_credit -= pkt_credit;
+        }
+        bytes_sent_add(p_ctx, p_ctx->notif_len);
     }
 }
 
 
-void nrf_ble_amts_rbc_set(nrf_ble_amts_t * p_ctx, uint32_t byte_cnt)
+void nrf_ble_amts_rbc_set(nrf_ble_amts_t * p_ctx, uint64_t byte_cnt)
 {
     uint8_t  data[AMT_RCV_BYTES_CNT_MAX_LEN];
-    uint16_t len;
+    uint16_t len = 0;
 
     ble_gatts_value_t value_param;
 
     memset(&value_param, 0x00, sizeof(value_param));
 
-    len = (uint16_t)uint32_encode(byte_cnt, data);
+    // Version byte followed by the count as a little endian 64-bit value.
+    data[len++] = AMT_RCV_BYTES_CNT_VERSION;
+    len += uint32_encode((uint32_t)byte_cnt, &data[len]);
+    len += uint32_encode((uint32_t)(byte_cnt >> 32), &data[len]);
+
     value_param.len     = len;
     value_param.p_value = data;
 
@@ -262,6 +927,142 @@ void nrf_ble_amts_rbc_set(nrf_ble_amts_t * p_ctx, uint32_t byte_cnt)
     }
 }
 
+
+static uint8_t  m_payload_expected[NRF_BLE_GATT_MAX_MTU_SIZE];   /**< Expected packet, regenerated when the payload type or length changes. */
+static uint8_t  m_payload_expected_type = AMT_PAYLOAD_NONE;      /**< Payload type of m_payload_expected. */
+static uint16_t m_payload_expected_len;                          /**< Length of m_payload_expected. */
+
+static const uint32_t m_crc32_table[16] =
+{
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+
+uint32_t nrf_ble_amt_crc32(uint8_t const * p_data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (len--)
+    {
+        crc ^= *p_data++;
+        crc  = (crc >> 4) ^ m_crc32_table[crc & 0x0F];
+        crc  = (crc >> 4) ^ m_crc32_table[crc & 0x0F];
+    }
+
+    return ~crc;
+}
+
+
+/**@brief Function for clocking k bits out of a Fibonacci LFSR at once.
+ *
+ * @details With the taps at bits n-1 and t-1, the next k <= t output bits only depend on the
+ *          current state, so they can be computed in one step. The first output bit is the MSB.
+ *
+ * @param     p_state   LFSR state, n bits.
+ * @param[in] n         Degree of the polynomial.
+ * @param[in] t         Degree of the middle term of the polynomial.
+ * @param[in] k         Number of bits to clock out.
+ */
+static uint32_t prbs_bits_get(uint32_t * p_state, uint32_t n, uint32_t t, uint32_t k)
+{
+    uint32_t state = *p_state;
+    uint32_t bits  = ((state >> (n - k)) ^ (state >> (t - k))) & ((1UL << k) - 1);
+
+    *p_state = ((state << k) | bits) & ((1UL << n) - 1);
+
+    return bits;
+}
+
+
+void nrf_ble_amt_payload_fill(uint8_t type, uint8_t * p_data, uint16_t len)
+{
+    uint32_t state;
+
+    switch (type)
+    {
+        case AMT_PAYLOAD_INCREMENTING:
+            for (uint16_t i = AMT_NOTIF_HDR_LEN; i < len; i++)
+            {
+                p_data[i] = (uint8_t)(i - AMT_NOTIF_HDR_LEN);
+            }
+            break;
+
+        case AMT_PAYLOAD_PRBS9:
+            // Only the 5 bits below the x^5 tap can be clocked out at once, use nibbles.
+            state = 0x1FF;
+            for (uint16_t i = AMT_NOTIF_HDR_LEN; i < len; i++)
+            {
+                uint32_t msn = prbs_bits_get(&state, 9, 5, 4);
+                p_data[i]    = (uint8_t)((msn << 4) | prbs_bits_get(&state, 9, 5, 4));
+            }
+            break;
+
+        case AMT_PAYLOAD_PRBS15:
+            state = 0x7FFF;
+            for (uint16_t i = AMT_NOTIF_HDR_LEN; i < len; i++)
+            {
+                p_data[i] = (uint8_t)prbs_bits_get(&state, 15, 14, 8);
+            }
+            break;
+
+        case AMT_PAYLOAD_FIXED_CRC32:
+            if (len >= AMT_NOTIF_HDR_LEN + AMT_PAYLOAD_CRC_LEN)
+            {
+                memset(&p_data[AMT_NOTIF_HDR_LEN], 0xA5, len - AMT_NOTIF_HDR_LEN - AMT_PAYLOAD_CRC_LEN);
+            }
+            break;
+
+        default:
+            if (len > AMT_NOTIF_HDR_LEN)
+            {
+                memset(&p_data[AMT_NOTIF_HDR_LEN], 0x00, len - AMT_NOTIF_HDR_LEN);
+            }
+            break;
+    }
+}
+
+
+void nrf_ble_amt_payload_seal(uint8_t type, uint8_t * p_data, uint16_t len)
+{
+    if ((type != AMT_PAYLOAD_FIXED_CRC32) || (len < AMT_NOTIF_HDR_LEN + AMT_PAYLOAD_CRC_LEN))
+    {
+        return;
+    }
+
+    uint32_t crc = nrf_ble_amt_crc32(p_data, len - AMT_PAYLOAD_CRC_LEN);
+    (void) uint32_encode(crc, &p_data[len - AMT_PAYLOAD_CRC_LEN]);
+}
+
+bool nrf_ble_amt_payload_check(uint8_t const * p_data, uint16_t len, uint8_t type)
+{
+    if ((type == AMT_PAYLOAD_NONE) || (type >= AMT_PAYLOAD_CNT) || (len <= AMT_NOTIF_HDR_LEN))
+    {
+        return true;
+    }
+
+    if (type == AMT_PAYLOAD_FIXED_CRC32)
+    {
+        if (len < AMT_NOTIF_HDR_LEN + AMT_PAYLOAD_CRC_LEN)
+        {
+            return false;
+        }
+        return (nrf_ble_amt_crc32(p_data, len - AMT_PAYLOAD_CRC_LEN) ==
+                uint32_decode(&p_data[len - AMT_PAYLOAD_CRC_LEN]));
+    }
+
+    if ((type != m_payload_expected_type) || (len != m_payload_expected_len))
+    {
+        nrf_ble_amt_payload_fill(type, m_payload_expected, len);
+        m_payload_expected_type = type;
+        m_payload_expected_len  = len;
+    }
+
+    return (memcmp(&p_data[AMT_NOTIF_HDR_LEN],
+                   &m_payload_expected[AMT_NOTIF_HDR_LEN],
+                   len - AMT_NOTIF_HDR_LEN) == 0);
+}
+
 /** @}
  *  @endcond
  */
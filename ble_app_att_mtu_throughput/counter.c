@@ -17,16 +17,62 @@
 #include "counter.h"
 #include "nrf_drv_rtc.h"
 
+#define COUNTER_BITS        24      /**< Width of the RTC COUNTER register. */
+#define COUNTER_MASK        ((1UL << COUNTER_BITS) - 1)
+#define DEADLINE_CC         0       /**< RTC compare channel of the deadline. */
+
 
 // RTC driver instance using RTC2.
 // RTC0 is used by the SoftDevice, and RTC1 by the app_timer library.
 static const nrf_drv_rtc_t m_rtc = NRF_DRV_RTC_INSTANCE(2);
 
+// Number of times the 24-bit RTC counter has wrapped since counter_init().
+static volatile uint32_t m_overflow_cnt;
+
+static volatile bool     m_running;         // Whether the stopwatch is running.
+static volatile uint64_t m_start_ticks;     // Timestamp of counter_start().
+static volatile uint64_t m_stop_ticks;      // Timestamp of counter_stop().
+
+static uint64_t                   m_deadline_len;       // Duration of a measurement, 0 if unlimited.
+static counter_deadline_handler_t m_deadline_handler;   // Called when the duration has elapsed.
+static volatile uint64_t          m_deadline_ticks;     // Timestamp at which the running measurement ends.
+
+
+static void deadline_check(void)
+{
+    if (!m_running || (m_deadline_len == 0))
+    {
+        return;
+    }
+
+    // The compare register only holds the low 24 bits, so it also matches
+    // on the wraps before the deadline of a measurement longer than 512 seconds.
+    if (counter_now() < m_deadline_ticks)
+    {
+        (void) nrf_drv_rtc_cc_set(&m_rtc, DEADLINE_CC, (uint32_t)(m_deadline_ticks & COUNTER_MASK), true);
+        return;
+    }
+
+    m_stop_ticks = m_deadline_ticks;
+    m_running    = false;
+
+    if (m_deadline_handler != NULL)
+    {
+        m_deadline_handler();
+    }
+}
+
 
 static void rtc_handler(nrf_drv_rtc_int_type_t int_type)
 {
-    // Likely a counter overflow.
-    APP_ERROR_CHECK(0xFFFFFFFF);
+    if (int_type == NRF_DRV_RTC_INT_OVERFLOW)
+    {
+        m_overflow_cnt++;
+    }
+    else if (int_type == NRF_DRV_RTC_INT_COMPARE0)
+    {
+        deadline_check();
+    }
 }
 
 
@@ -37,34 +83,98 @@ void counter_init(void)
     // Initialize the RTC instance.
     nrf_drv_rtc_config_t config = NRF_DRV_RTC_DEFAULT_CONFIG;
 
-    // 10 ms interval.
-    config.prescaler = 0;//327;
+    // No prescaling, the counter runs at COUNTER_FREQ_HZ.
+    config.prescaler = 0;
 
     err_code = nrf_drv_rtc_init(&m_rtc, &config, rtc_handler);
     APP_ERROR_CHECK(err_code);
 
     nrf_drv_rtc_tick_disable(&m_rtc);
+
+    // The 24-bit counter wraps every 512 seconds, count the wraps in software.
+    nrf_drv_rtc_overflow_enable(&m_rtc, true);
+
+    // Power on! The counter runs freely, start and stop only take timestamps.
+    nrf_drv_rtc_enable(&m_rtc);
 }
 
 
 void counter_start(void)
 {
-    nrf_drv_rtc_counter_clear(&m_rtc);
-
-    // Power on!
-    nrf_drv_rtc_enable(&m_rtc);
+    m_start_ticks = counter_now();
+    m_running     = true;
+
+    if (m_deadline_len != 0)
+    {
+        m_deadline_ticks = m_start_ticks + m_deadline_len;
+        (void) nrf_drv_rtc_cc_set(&m_rtc, DEADLINE_CC, (uint32_t)(m_deadline_ticks & COUNTER_MASK), true);
+    }
 }
 
 
 void counter_stop(void)
 {
-    nrf_drv_rtc_disable(&m_rtc);
+    if (m_running)
+    {
+        m_stop_ticks = counter_now();
+        m_running    = false;
+
+        (void) nrf_drv_rtc_cc_disable(&m_rtc, DEADLINE_CC);
+    }
+}
+
+
+void counter_deadline_set(uint64_t ticks, counter_deadline_handler_t handler)
+{
+    m_deadline_len     = ticks;
+    m_deadline_handler = handler;
+}
+
+
+uint64_t counter_get(void)
+{
+    uint64_t end_ticks = m_running ? counter_now() : m_stop_ticks;
+
+    return (end_ticks - m_start_ticks);
+}
+
+
+uint64_t counter_now(void)
+{
+    uint32_t overflow_cnt;
+    uint32_t epoch;
+    uint32_t ticks;
+
+    // Retry if the overflow interrupt was serviced while reading.
+    do
+    {
+        epoch        = m_overflow_cnt;
+        overflow_cnt = epoch;
+        ticks        = nrf_drv_rtc_counter_get(&m_rtc);
+
+        // The counter has wrapped, but the interrupt has not been serviced yet
+        // (the caller may run at a higher priority than the RTC interrupt).
+        if (nrf_rtc_event_pending(m_rtc.p_reg, NRF_RTC_EVENT_OVERFLOW))
+        {
+            overflow_cnt++;
+            ticks = nrf_drv_rtc_counter_get(&m_rtc);
+        }
+    } while (epoch != m_overflow_cnt);
+
+    return (((uint64_t)overflow_cnt << COUNTER_BITS) | ticks);
+}
+
+
+uint64_t counter_get_us(void)
+{
+    return counter_ticks_to_us(counter_get());
 }
 
 
-uint32_t counter_get(void)
+uint64_t counter_ticks_to_us(uint64_t ticks)
 {
-    return(nrf_drv_rtc_counter_get(&m_rtc));
+    // 1000000 / 32768 = 15625 / 512.
+    return ((ticks * 15625) / 512);
 }
 
 /** @}
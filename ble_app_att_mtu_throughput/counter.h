@@ -18,6 +18,12 @@
 
 #include <stdint.h>
 
+#define COUNTER_FREQ_HZ     32768   /**< Frequency of the counter, in ticks per second. */
+
+
+/**@brief   Deadline handler type, called from the RTC interrupt. */
+typedef void (*counter_deadline_handler_t)(void);
+
 /**@brief   Function for initializing the RTC driver instance. */
 void counter_init(void);
 
@@ -30,12 +36,36 @@ void counter_start(void);
 void counter_stop(void);
 
 
-/*@brief    Function for retrieving the counter value. */
-uint32_t counter_get(void);
+/**@brief   Function for limiting the following measurements to a fixed duration.
+ *
+ * @details Once the counter has run for @p ticks after counter_start(), it is stopped at exactly
+ *          that point and @p handler is called. The setting applies until it is changed.
+ *
+ * @param[in] ticks     Duration in counter ticks, 0 to run until counter_stop().
+ * @param[in] handler   Function to call when the deadline is reached.
+ */
+void counter_deadline_set(uint64_t ticks, counter_deadline_handler_t handler);
+
+
+/**@brief   Function for retrieving the number of ticks between counter_start() and
+ *          counter_stop(), or until now if the counter is still running. */
+uint64_t counter_get(void);
+
+
+/**@brief   Function for retrieving the counter value in microseconds. */
+uint64_t counter_get_us(void);
+
+
+/**@brief   Function for retrieving the free running timestamp, in ticks since counter_init().
+ *
+ * @details The 24-bit RTC counter is extended to 64 bits by counting overflows, so the value
+ *          does not wrap during long tests. Safe to call from any interrupt priority.
+ */
+uint64_t counter_now(void);
 
 
-/**@brief   Function for printing the counter value. */
-void counter_print(void);
+/**@brief   Function for converting a number of counter ticks to microseconds. */
+uint64_t counter_ticks_to_us(uint64_t ticks);
 
 #endif // COUNTER_H__
 /** @}
@@ -267,6 +267,84 @@ void display_show()
 
 static uint8_t line_counter = 0;
 
+//printf and the log only handle 32-bit integers, convert 64-bit counts by hand
+char * uint64_to_str(uint64_t value, char * str)
+{
+	char tmp[21];
+	uint8_t len = 0;
+	
+	do
+	{
+		tmp[len++] = '0' + (value % 10);
+		value /= 10;
+	} while(value != 0);
+	
+	for(uint8_t i = 0; i < len; i++)
+	{
+		str[i] = tmp[len - 1 - i];
+	}
+	str[len] = '\0';
+	
+	return str;
+}
+
+//Welford's algorithm, does not lose precision when the spread is small compared to the mean
+void running_stats_add(running_stats_t * p_stats, float value)
+{
+	if(p_stats->cnt == 0)
+	{
+		p_stats->min = value;
+		p_stats->max = value;
+	}
+	else if(value < p_stats->min)
+	{
+		p_stats->min = value;
+	}
+	else if(value > p_stats->max)
+	{
+		p_stats->max = value;
+	}
+	
+	p_stats->cnt++;
+	
+	float delta = value - p_stats->mean;
+	p_stats->mean += delta / p_stats->cnt;
+	p_stats->m2 += delta * (value - p_stats->mean);
+}
+
+//sample standard deviation
+float running_stats_stddev(running_stats_t const * p_stats)
+{
+	if(p_stats->cnt < 2)
+	{
+		return 0;
+	}
+	
+	return sqrtf(p_stats->m2 / (p_stats->cnt - 1));
+}
+
+//two-sided 95% Student's t quantiles for 1 to 30 degrees of freedom
+static const float m_t95[] =
+{
+	12.706f, 4.303f, 3.182f, 2.776f, 2.571f, 2.447f, 2.365f, 2.306f, 2.262f, 2.228f,
+	2.201f, 2.179f, 2.160f, 2.145f, 2.131f, 2.120f, 2.110f, 2.101f, 2.093f, 2.086f,
+	2.080f, 2.074f, 2.069f, 2.064f, 2.060f, 2.056f, 2.052f, 2.048f, 2.045f, 2.042f,
+};
+
+//half width of the 95% confidence interval of the mean, 0 until there are two values
+float running_stats_ci95(running_stats_t const * p_stats)
+{
+	if(p_stats->cnt < 2)
+	{
+		return 0;
+	}
+	
+	uint32_t df = p_stats->cnt - 1;
+	float t = (df <= sizeof(m_t95)/sizeof(m_t95[0])) ? m_t95[df - 1] : 1.96f;
+	
+	return t * running_stats_stddev(p_stats) / sqrtf(p_stats->cnt);
+}
+
 uint8_t display_get_line_nr()
 {
 	return line_counter;
@@ -327,8 +405,8 @@ void display_print_line(char * line, uint32_t x_pos, uint8_t line_nr)
 
 void display_draw_test_run_screen(transfer_data_t *transfer_data, rssi_data_t *rssi_data)
 {
-	static uint32_t last_counter_ticks = 0;
-	static uint32_t last_bytes_transferred = 0;
+	static uint64_t last_counter_ticks = 0;
+	static uint64_t last_bytes_transferred = 0;
 	
 	static float throughput = 0;
 	
@@ -336,7 +414,7 @@ void display_draw_test_run_screen(transfer_data_t *transfer_data, rssi_data_t *r
 	if(transfer_data->counter_ticks != 0 && (transfer_data->counter_ticks - last_counter_ticks) > 10000)
 	{
 		float sent_bits = (transfer_data->bytes_transfered - last_bytes_transferred) * 8;
-		throughput = (float)(sent_bits * 32768 / 1000) / (transfer_data->counter_ticks - last_counter_ticks);
+		throughput = (float)(sent_bits * COUNTER_FREQ_HZ / 1000) / (transfer_data->counter_ticks - last_counter_ticks);
 		
 		last_bytes_transferred = transfer_data->bytes_transfered;
 		last_counter_ticks = transfer_data->counter_ticks;
@@ -350,6 +428,21 @@ void display_draw_test_run_screen(transfer_data_t *transfer_data, rssi_data_t *r
 	display_print_line_center_inc("Transferring data:");
 	NRF_LOG_RAW_INFO("Transferring data:\r\n");
 	
+	//timed runs show the elapsed time instead of the transferred data
+	uint32_t progress_done  = (uint32_t)(transfer_data->bytes_transfered/1024);
+	uint32_t progress_total = transfer_data->kb_transfer_size;
+	
+	if(transfer_data->duration != 0)
+	{
+		progress_done  = (uint32_t)(transfer_data->counter_ticks/COUNTER_FREQ_HZ);
+		progress_total = transfer_data->duration;
+	}
+	
+	if(progress_done > progress_total)
+	{
+		progress_done = progress_total;
+	}
+	
 	if(m_display_connected)
 	{
 		//print filled bar
@@ -361,7 +454,7 @@ void display_draw_test_run_screen(transfer_data_t *transfer_data, rssi_data_t *r
 		
 		fb_bar((FB_UTIL_LCD_WIDTH - TRANSFER_BAR_LENGTH)/2, 
 				line_counter*TEXT_HEIGHT + TEXT_HEIGHT/2 + TEXT_START_YPOS,
-				(FB_UTIL_LCD_WIDTH - TRANSFER_BAR_LENGTH)/2 + (uint32_t)(transfer_data->bytes_transfered/1024)*TRANSFER_BAR_LENGTH / transfer_data->kb_transfer_size, 
+				(FB_UTIL_LCD_WIDTH - TRANSFER_BAR_LENGTH)/2 + progress_done*TRANSFER_BAR_LENGTH / progress_total, 
 				(line_counter + TRANSFER_BAR_HEIGHT_IN_LINES)*TEXT_HEIGHT + TEXT_START_YPOS + TEXT_HEIGHT/2, 
 				FB_COLOR_BLACK);
 		
@@ -371,7 +464,7 @@ void display_draw_test_run_screen(transfer_data_t *transfer_data, rssi_data_t *r
 	NRF_LOG_RAW_INFO("[");
 	for(uint32_t i = 0; i < TERMINAL_TRANSFER_BAR_LENGTH; i++)
 	{
-		if(i < (uint32_t)(transfer_data->bytes_transfered/1024*TERMINAL_TRANSFER_BAR_LENGTH)/transfer_data->kb_transfer_size)
+		if(i < (progress_done*TERMINAL_TRANSFER_BAR_LENGTH)/progress_total)
 		{
 			NRF_LOG_RAW_INFO("#");
 		}
@@ -383,7 +476,14 @@ void display_draw_test_run_screen(transfer_data_t *transfer_data, rssi_data_t *r
 	NRF_LOG_RAW_INFO("]\r\n");
 	
 	char str[50];
-	sprintf(str, "%dKB/%dKB transferred", transfer_data->bytes_transfered/1024, transfer_data->kb_transfer_size);
+	if(transfer_data->duration != 0)
+	{
+		sprintf(str, "%uKB in %us/%us", (uint32_t)(transfer_data->bytes_transfered/1024), progress_done, progress_total);
+	}
+	else
+	{
+		sprintf(str, "%uKB/%dKB transferred", (uint32_t)(transfer_data->bytes_transfered/1024), transfer_data->kb_transfer_size);
+	}
 	display_print_line_center_inc(str);
 	NRF_LOG_RAW_INFO("%s\r\n", nrf_log_push(str));
 
@@ -413,6 +513,14 @@ void display_draw_test_run_screen(transfer_data_t *transfer_data, rssi_data_t *r
 		display_print_line_center_inc(str);
 		NRF_LOG_RAW_INFO("%s\r\n", nrf_log_push(str));
 	}
+	
+	if(transfer_data->throughput_stats.cnt > 1)
+	{
+		sprintf(str, "Mean of %u: %.2f +-%.2f", transfer_data->throughput_stats.cnt,
+				transfer_data->throughput_stats.mean, running_stats_ci95(&transfer_data->throughput_stats));
+		display_print_line_center_inc(str);
+		NRF_LOG_RAW_INFO("%s\r\n", nrf_log_push(str));
+	}
 		
 	display_print_line_center_inc("Press any key to terminate the test");
 	NRF_LOG_RAW_INFO("Press any key to terminate the test\r\n");
@@ -427,16 +535,17 @@ void display_test_done_screen(transfer_data_t *transfer_data, rssi_data_t *rssi_
 	char str[50];
 	uint16_t number_x_pos = 130;
 
-	sprintf(str, "%.2f seconds.", (float)transfer_data->counter_ticks / 32768);
+	sprintf(str, "%.2f seconds.", (float)transfer_data->counter_ticks / COUNTER_FREQ_HZ);
 	display_print_line(str, number_x_pos, display_get_line_nr());
 	display_print_line_inc("Time:");
 	
-	sprintf(str, "%u KB (%u bytes)).", transfer_data->bytes_transfered/1024, transfer_data->bytes_transfered);
+	char bytes_str[21];
+	sprintf(str, "%u KB (%s bytes).", (uint32_t)(transfer_data->bytes_transfered/1024), uint64_to_str(transfer_data->bytes_transfered, bytes_str));
 	display_print_line(str, number_x_pos, display_get_line_nr());
 	display_print_line_inc("Transfered:");
 	
 	float sent_octet_cnt = transfer_data->bytes_transfered * 8;
-	float throughput = (float)(sent_octet_cnt * 32768) / (float)transfer_data->counter_ticks;
+	float throughput = (float)(sent_octet_cnt * COUNTER_FREQ_HZ) / (float)transfer_data->counter_ticks;
 	throughput = throughput / (float)1000;
 	
 	sprintf(str, "%.2f Kbits/s.", throughput);
@@ -453,6 +562,29 @@ void display_test_done_screen(transfer_data_t *transfer_data, rssi_data_t *rssi_
 		display_print_line_inc("Average RSSI:");
 	}
 	
+	running_stats_t const * p_stats = &transfer_data->throughput_stats;
+	
+	if(p_stats->cnt > 1)
+	{
+		display_print_line_inc("");
+		
+		sprintf(str, "%u", p_stats->cnt);
+		display_print_line(str, number_x_pos, display_get_line_nr());
+		display_print_line_inc("Transfers:");
+		
+		sprintf(str, "%.2f +-%.2f Kbits/s.", p_stats->mean, running_stats_ci95(p_stats));
+		display_print_line(str, number_x_pos, display_get_line_nr());
+		display_print_line_inc("Mean (95% CI):");
+		
+		sprintf(str, "%.2f Kbits/s.", running_stats_stddev(p_stats));
+		display_print_line(str, number_x_pos, display_get_line_nr());
+		display_print_line_inc("Std deviation:");
+		
+		sprintf(str, "%.2f / %.2f Kbits/s.", p_stats->min, p_stats->max);
+		display_print_line(str, number_x_pos, display_get_line_nr());
+		display_print_line_inc("Min / max:");
+	}
+	
 	display_print_line_inc("");
 	display_print_line_inc("Press any button to exit.");
 	
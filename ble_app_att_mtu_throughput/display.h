@@ -18,6 +18,24 @@
 
 #define MAX_LINES						10
 
+typedef enum
+{
+	TRANSFER_MODE_NOTIF,				//tester notifies the dummy
+	TRANSFER_MODE_WRITE,				//dummy writes to the tester with Write Without Response
+	TRANSFER_MODE_DUPLEX,				//both at the same time
+	TRANSFER_MODE_INDICATION,			//tester indicates the dummy, one indication at a time
+} transfer_mode_t;
+
+typedef enum
+{
+	SWEEP_AXES_PHY_CONN_INTERVAL,		//PHY x connection interval, the default
+	SWEEP_AXES_PHY_ATT_MTU,				//PHY x ATT MTU
+	SWEEP_AXES_CONN_INTERVAL_ATT_MTU,	//connection interval x ATT MTU
+	SWEEP_AXES_PHY_CONN_INTERVAL_ATT_MTU,	//PHY x connection interval x ATT MTU
+	SWEEP_AXES_EXT_TX_POWER,			//data length ext x connection event ext x TX power
+	SWEEP_AXES_ALL,						//all six parameter lists
+} sweep_axes_t;
+
 typedef struct
 {
     uint16_t att_mtu;                   // GATT ATT MTU, in bytes. 
@@ -28,6 +46,13 @@ typedef struct
 	int8_t 	 tx_power;					//output power
 	uint8_t  link_budget;				//link budget (output power minus sensitivity)
 	uint16_t transfer_data_size;		//transfer data size in kB
+	uint8_t  transfer_mode;				//direction of the transfer, see transfer_mode_t
+	uint8_t  payload_type;				//content of the notifications, see amt_payload_t
+	uint16_t pace_kbps;					//constant bitrate of the notifications in kbps, 0 for as fast as possible
+	uint16_t duration;					//test duration in seconds, 0 to transfer transfer_data_size instead
+	uint8_t  data_channels;				//number of data channels the tester allows, 0 for all
+	uint8_t  link_cnt;					//number of dummies the tester streams to at the same time, 0 is taken as 1
+	uint8_t  sweep_axes;				//parameters the sweep varies, see sweep_axes_t
 	char *	 ble_version;
 } test_params_t;
 
@@ -42,15 +67,27 @@ typedef struct
     uint8_t     link_budget_max;
 	uint32_t 	range_multiplier;
     uint32_t    range_multiplier_max;
-	float 		moving_average;
+	int32_t 	moving_average;		//RSSI_Q_BITS fractional bits, in dBm
 } rssi_data_t;
 
+/**@brief Running statistics, updated one value at a time with Welford's algorithm. */
+typedef struct
+{
+	uint32_t	cnt;
+	float		mean;
+	float		m2;				//sum of squared differences from the mean
+	float		min;
+	float		max;
+} running_stats_t;
+
 typedef struct
 {
 	uint16_t kb_transfer_size;
-	uint32_t bytes_transfered;
-	uint32_t counter_ticks;
+	uint16_t duration;
+	uint64_t bytes_transfered;
+	uint64_t counter_ticks;
 	float last_throughput;
+	running_stats_t throughput_stats;	//throughput of the transfers run with the current parameters
 } transfer_data_t;
 
 bool display_init(void);
@@ -69,4 +106,10 @@ void display_clear(void);
 
 uint8_t display_get_line_nr(void);
 
+char * uint64_to_str(uint64_t value, char * str);
+
+void running_stats_add(running_stats_t * p_stats, float value);
+float running_stats_stddev(running_stats_t const * p_stats);
+float running_stats_ci95(running_stats_t const * p_stats);
+
 #endif //DISPLAY_H
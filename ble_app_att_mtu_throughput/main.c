@@ -18,7 +18,6 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
-#include <math.h>
 
 #include "amt.h"
 #include "counter.h"
@@ -37,6 +36,7 @@
 #include "softdevice_handler.h"
 #include "nrf_ble_gatt.h"
 #include "app_timer.h"
+#include "app_util_platform.h"
 #include "app_error.h"
 #include "ble_conn_params.h"
 
@@ -46,9 +46,10 @@
 
 #include "display.h"
 #include "menu.h"
+#include "rssi.h"
 
 #define TIMER_PRESCALER         0                                   /**< Value of the RTC1 PRESCALER register. */
-#define TIMER_OP_QUEUE_SIZE     4                                   /**< Size of timer operation queues. */
+#define TIMER_OP_QUEUE_SIZE     6                                   /**< Size of timer operation queues. */
 
 #define ATT_MTU_DEFAULT         247                                 /**< Default ATT MTU size, in bytes. */
 #define CONN_INTERVAL_DEFAULT_MS 400.0
@@ -77,16 +78,32 @@
 #define SENSITIVITY_1MBPS	      (-96)
 #define SENSITIVITY_2MBPS	      (-93)
 
-#define RSSI_MOVING_AVERAGE_ALPHA	0.9f		//higher value will lower the frequency of the filter
-
 #define DISPLAY_TIMER_UPDATE_INTERVAL	APP_TIMER_TICKS(200, TIMER_PRESCALER)
 APP_TIMER_DEF(m_display_timer_id);
 
+#define PACE_TIMER_INTERVAL			APP_TIMER_TICKS(5, TIMER_PRESCALER)	/**< Refill interval of the token bucket of paced transfers. */
+APP_TIMER_DEF(m_pace_timer_id);
+
+#define SWEEP_RUNS_PER_POINT		3			//number of transfers for each point in the parameter sweep
+#define SWEEP_SETUP_S				5			//rough time to reconnect and set up the link at each sweep point, for the run time estimate
+#define STEADY_STATE_TRIM_PERCENT	5			//share of the bytes left out at each end of the steady state throughput window
+#define TRACE_SAMPLE_CNT			256			//number of display timer samples kept for the trace, the oldest are overwritten
+#define BLE_DATA_CHANNEL_CNT		37			//number of BLE data channels
+#define RSSI_BIN_DB					5			//width of the link quality RSSI bins
+#define RSSI_BIN_MIN_DBM			(-100)		//lower edge of the first link quality bin, weaker samples are counted there too
+#define RSSI_BIN_CNT				14			//number of link quality bins, stronger samples are counted in the last one
+#define LINK_CNT					(NRF_BLE_CENTRAL_LINK_COUNT + NRF_BLE_PERIPHERAL_LINK_COUNT)	//connections the SoftDevice is configured for
+#define BLE_EVT_ID_CNT				(BLE_GATTS_EVT_LAST + 1)	//the common, GAP, GATT client and GATT server event IDs
+#define BLE_EVT_HANDLER_MAX			8			//handlers that can subscribe to BLE stack events, one bit each in m_ble_evt_subscribers
+#define APP_EVT_QUEUE_SIZE			16			//events waiting for the main loop, must be a power of two
+#define RELAY_QUEUE_SIZE			16			//notifications the relay holds until they are sent on, must be a power of two
+
 typedef enum
 {
     NOT_SELECTED = 0x00,
     BOARD_TESTER,
     BOARD_DUMMY,
+    BOARD_RELAY,						//dummy of one tester and tester of one dummy, forwarding the notifications
 } board_role_t;
 
 static void button_event_handler(uint8_t pin_no, uint8_t button_action);
@@ -99,13 +116,148 @@ static app_button_cfg_t buttons[] =
 	{BUTTON_4,  false, BUTTON_PULL, button_event_handler}
 };
 
-static uint8_t m_button = 0xff;
+/**@brief Events pushed from interrupt context and handled one at a time by the main loop. */
+typedef enum
+{
+	APP_EVT_BUTTON,						//button pushed that did not stop a test, param is the pin
+	APP_EVT_DISPLAY_SHOW,				//lines were added to the display
+	APP_EVT_DISPLAY_TRANSFER,			//the display timer updated the transfer data
+	APP_EVT_TRANSFER_DONE,				//show the results of the test
+	APP_EVT_MENU,						//all links are down, back to the menu
+	APP_EVT_SWEEP_NEXT,					//all links are down, on to the next sweep point
+	APP_EVT_TRACE_PRINT,				//print the trace and the link quality bins of the finished run
+	APP_EVT_TEST_STOP,					//a button was pushed while the test was running
+} app_evt_type_t;
+
+typedef struct
+{
+	uint8_t		type;					//see app_evt_type_t
+	uint8_t		param;
+} app_evt_t;
+
+/**@brief What the user interface waits for, the buttons are handled according to it. */
+typedef enum
+{
+	UI_STATE_ROLE_SELECT,				//button selecting the role of the board
+	UI_STATE_MENU,						//menu navigation
+	UI_STATE_BUSY,						//test being set up or running, or not the tester. Buttons stop a running test
+	UI_STATE_TEST_READY,				//any button starts the test
+	UI_STATE_TEST_DONE,					//results shown, any button goes back to the menu
+	UI_STATE_SWEEP_DONE,				//sweep results printed, any button goes back to the menu
+} ui_state_t;
+
+static app_evt_t				m_app_evts[APP_EVT_QUEUE_SIZE];
+static uint32_t volatile		m_app_evt_in;
+static uint32_t volatile		m_app_evt_out;
+static uint32_t volatile		m_app_evt_pending;		//bit per app_evt_type_t in the queue
+static ui_state_t				m_ui_state = UI_STATE_ROLE_SELECT;
+static bool						m_menu_pending = false;	//all links went down while the results were shown
+
+static transfer_data_t			m_transfer_data = {.kb_transfer_size = (AMT_BYTE_TRANSFER_CNT_DEFAULT/1024), .bytes_transfered = 0};	//all links together
+
+/* Parameter values covered by the sweep. The sweep runs the Cartesian product of the lists picked
+ * on the "Sweep axes" menu page, the other parameters keep their menu value.
+ *
+ * Run time: each point takes about SWEEP_SETUP_S plus SWEEP_RUNS_PER_POINT transfers. A timed run
+ * bounds a transfer to the test duration, so a sweep of N points takes about
+ * N * (SWEEP_SETUP_S + SWEEP_RUNS_PER_POINT * duration), e.g. 4 min for the 6 points of the default
+ * PHY x connection interval axes on S132 with 10 s runs. A run bounded by size is only fast at
+ * the high end: 1024 KB take a few seconds on 2 Mbps with a 247 byte MTU, but close to an hour on
+ * 1 Mbps with a 23 byte MTU, a 400 ms interval and no event length extension. All six lists make
+ * 144 points on S132 and 324 on S140, which only fit in an unattended night with timed runs.
+ */
+#if defined(S132)
+static const uint8_t	m_sweep_phys[]			= {BLE_GAP_PHY_2MBPS, BLE_GAP_PHY_1MBPS};
+static const int8_t		m_sweep_tx_powers[]		= {0, 4};
+#elif defined(S140)
+static const uint8_t	m_sweep_phys[]			= {BLE_GAP_PHY_2MBPS, BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_CODED};
+static const int8_t		m_sweep_tx_powers[]		= {0, 4, 8};
+#endif
+static const float		m_sweep_conn_intervals[]	= {7.5f, 50.0f, 400.0f};
+static const uint16_t	m_sweep_att_mtus[]		= {23, 158, 247};
+static const bool		m_sweep_data_len_ext[]		= {true, false};
+static const bool		m_sweep_conn_evt_len_ext[]	= {true, false};
+
+#define SWEEP_POINT_MAX	(ARRAY_SIZE(m_sweep_phys) * ARRAY_SIZE(m_sweep_conn_intervals) * ARRAY_SIZE(m_sweep_att_mtus) \
+						* ARRAY_SIZE(m_sweep_data_len_ext) * ARRAY_SIZE(m_sweep_conn_evt_len_ext) * ARRAY_SIZE(m_sweep_tx_powers))
+
+/* Parameter lists the sweep varies, one bit each. */
+#define SWEEP_AXIS_PHY				0x01
+#define SWEEP_AXIS_CONN_INTERVAL	0x02
+#define SWEEP_AXIS_ATT_MTU			0x04
+#define SWEEP_AXIS_DATA_LEN_EXT		0x08
+#define SWEEP_AXIS_CONN_EVT_LEN_EXT	0x10
+#define SWEEP_AXIS_TX_POWER			0x20
+
+/* Lists varied by each choice of the "Sweep axes" menu page, indexed by sweep_axes_t. */
+static const uint8_t	m_sweep_axes_masks[]	=
+{
+	SWEEP_AXIS_PHY | SWEEP_AXIS_CONN_INTERVAL,
+	SWEEP_AXIS_PHY | SWEEP_AXIS_ATT_MTU,
+	SWEEP_AXIS_CONN_INTERVAL | SWEEP_AXIS_ATT_MTU,
+	SWEEP_AXIS_PHY | SWEEP_AXIS_CONN_INTERVAL | SWEEP_AXIS_ATT_MTU,
+	SWEEP_AXIS_DATA_LEN_EXT | SWEEP_AXIS_CONN_EVT_LEN_EXT | SWEEP_AXIS_TX_POWER,
+	SWEEP_AXIS_PHY | SWEEP_AXIS_CONN_INTERVAL | SWEEP_AXIS_ATT_MTU
+	| SWEEP_AXIS_DATA_LEN_EXT | SWEEP_AXIS_CONN_EVT_LEN_EXT | SWEEP_AXIS_TX_POWER,
+};
+
+/**@brief Connection setup milestones, in the order they normally occur. */
+typedef enum
+{
+	SETUP_START,					//scanning or advertising started
+	SETUP_ADV_REPORT,				//advertising report with matching name received
+	SETUP_CONNECTED,
+	SETUP_DB_DISCOVERED,
+	SETUP_CCCD_WRITTEN,
+	SETUP_MTU_EXCHANGED,
+	SETUP_PHY_UPDATED,
+	SETUP_CONN_PARAM_UPDATED,
+	SETUP_FIRST_TX_COMPLETE,
+	SETUP_MILESTONE_CNT,
+} setup_milestone_t;
+
+static char const * const m_setup_milestone_str[SETUP_MILESTONE_CNT] =
+{
+	"Scan/adv start",
+	"Adv report match",
+	"Connected",
+	"DB discovery done",
+	"CCCD written",
+	"MTU exchanged",
+	"PHY updated",
+	"Conn params updated",
+	"First TX complete",
+};
+
+/**@brief Latency of one setup milestone relative to SETUP_START, across connections. */
+typedef struct
+{
+	uint32_t			last;		//latency of the last connection in counter ticks
+	running_stats_t		ms;			//latencies in milliseconds
+} setup_stats_t;
+
+static uint64_t					m_setup_ticks[SETUP_MILESTONE_CNT];		//timestamps of the current connection setup
+static uint32_t volatile		m_setup_mask;							//milestones reached in the current connection setup
+static setup_stats_t			m_setup_stats[SETUP_MILESTONE_CNT];
+static bool volatile			m_setup_report_pending = false;
 
-static volatile bool 			m_display_show = false;
-static volatile bool 			m_display_show_transfer_data = false;
-static volatile bool			m_transfer_done = false;
-static transfer_data_t			m_transfer_data = {.kb_transfer_size = (AMT_BYTE_TRANSFER_CNT_DEFAULT/1024), .bytes_transfered = 0};
-static rssi_data_t				m_rssi_data;
+/**@brief Throughput results of the transfers run for one sweep point. */
+typedef struct
+{
+	uint8_t		runs;
+	float		min;
+	float		max;
+	float		sum;
+} sweep_result_t;
+
+static sweep_result_t			m_sweep_results[SWEEP_POINT_MAX];
+static uint8_t					m_sweep_axis_mask;		//lists varied by the current sweep, see SWEEP_AXIS_PHY
+static uint16_t					m_sweep_point_cnt;		//points of the current sweep
+static test_params_t			m_sweep_menu_params;	//menu parameters when the sweep began, restored when it ends
+static uint16_t					m_sweep_point;
+static uint8_t					m_sweep_run;
+static bool volatile			m_sweep_active = false;
+static bool volatile			m_sweep_abort = false;
 
 /**@brief Variable length data encapsulation in terms of length and pointer to data. */
 typedef struct
@@ -114,25 +266,148 @@ typedef struct
     uint16_t   data_len;    /**< Length of data. */
 } data_t;
 
-static nrf_ble_amtc_t m_amtc;
-static nrf_ble_amts_t m_amts;
+/**@brief Transfer progress since the test was started. */
+typedef struct
+{
+	uint64_t	ticks;				//counter ticks since the test was started
+	uint64_t	bytes;				//bytes transferred since the test was started
+	uint32_t	tx_complete_cnt;	//TX_COMPLETE events since the test was started
+} trace_progress_t;
+
+/**@brief One sample of the throughput trace, taken by the display timer.
+ *
+ * @details Holds the progress since the previous sample, which keeps it at 12 bytes. The totals
+ *          are rebuilt from m_trace_progress when the trace is printed.
+ */
+typedef struct
+{
+	uint32_t	ticks;				//counter ticks since the previous sample
+	uint32_t	bytes;				//bytes transferred since the previous sample
+	uint16_t	tx_complete_cnt;	//TX_COMPLETE events since the previous sample
+	int8_t		rssi;				//last RSSI reading in dBm
+} trace_sample_t;
+
+static trace_sample_t			m_trace[TRACE_SAMPLE_CNT];
+static uint32_t					m_trace_cnt;		//samples taken in the current run, including overwritten ones
+static uint64_t					m_trace_start_ticks;
+static trace_progress_t			m_trace_progress;	//progress at the latest sample
+
+/**@brief Transfer progress during the display timer periods that ended with an RSSI in one bin. */
+typedef struct
+{
+	uint32_t	periods;			//number of display timer periods
+	uint32_t	stalls;				//periods in which no data was transferred
+	uint64_t	ticks;				//total duration of the periods
+	uint64_t	bytes;				//bytes transferred in the periods
+	uint32_t	tx_complete_cnt;	//TX_COMPLETE events in the periods
+	uint32_t	pkt_cnt;			//packets completed in the periods
+} rssi_bin_t;
+
+static rssi_bin_t				m_rssi_bins[RSSI_BIN_CNT];
+static trace_progress_t			m_rssi_bin_prev;	//progress at the end of the previous period
+static uint32_t					m_rssi_bin_prev_pkt_cnt;
+
+/**@brief Test state of one link. */
+typedef enum
+{
+	LINK_STATE_FREE,					//no connection
+	LINK_STATE_SETUP,					//connected, waiting for the LINK_SETUP_* steps
+	LINK_STATE_READY,					//set up, waiting for the test to start
+	LINK_STATE_RUNNING,					//transfer running
+	LINK_STATE_FINISHED,				//transfer ended, waiting for the other links
+	LINK_STATE_DISCONNECTING,			//disconnection requested by terminate_test()
+} link_state_t;
+
+#define LINK_SETUP_NOTIF_ENABLED	(1 << 0)
+#define LINK_SETUP_MTU_EXCHANGED	(1 << 1)
+#define LINK_SETUP_PHY_UPDATED		(1 << 2)
+#define LINK_SETUP_CONN_PARAMS		(1 << 3)
+#define LINK_SETUP_ALL				(LINK_SETUP_NOTIF_ENABLED | LINK_SETUP_MTU_EXCHANGED | LINK_SETUP_PHY_UPDATED | LINK_SETUP_CONN_PARAMS)
+
+/**@brief State of one connection, at the index of its connection handle.
+ *
+ * @details The tester has one per dummy, the dummy only one. The fields used on every event come
+ *          first, the module instances last.
+ */
+typedef struct
+{
+	uint16_t			conn_handle;
+	uint8_t				role;						//BLE_GAP_ROLE_PERIPH or BLE_GAP_ROLE_CENTRAL
+	uint8_t volatile	state;						//see link_state_t
+	uint8_t volatile	setup_mask;					//LINK_SETUP_* steps done
+	uint64_t			duplex_rcvd_start;			//amts.bytes_rcvd when the counter was started
+	transfer_data_t		transfer;					//bytes and ticks of the current or last transfer on this link
+	rssi_data_t			rssi;
+	nrf_ble_amts_t		amts;
+	nrf_ble_amtc_t		amtc;
+	ble_db_discovery_t	db_discovery;
+} link_ctx_t;
+
+static link_ctx_t				m_links[LINK_CNT];
+
+/**@brief Handler of BLE stack events, p_link is NULL for the events of a connection without a link. */
+typedef void (*ble_evt_handler_t)(ble_evt_t * p_ble_evt, link_ctx_t * p_link);
+
+typedef struct
+{
+	ble_evt_handler_t	handler;
+	bool				per_link;				//only called with a link
+} ble_evt_handler_entry_t;
+
+static ble_evt_handler_entry_t	m_ble_evt_handlers[BLE_EVT_HANDLER_MAX];
+static uint32_t					m_ble_evt_handler_cnt;
+static uint8_t					m_ble_evt_subscribers[BLE_EVT_ID_CNT];	//bit per entry of m_ble_evt_handlers, by event ID
+
+/**@brief Notification held by the relay until the SoftDevice has sent it on.
+ *
+ * @details The ticks are truncated to 32 bits, enough for the differences taken while the
+ *          notification is queued.
+ */
+typedef struct
+{
+	uint32_t	rcvd_ticks;					//arrival from the upstream peer
+	uint32_t	sent_ticks;					//handed to the SoftDevice for the downstream peer
+	uint16_t	len;
+	uint8_t		data[NRF_BLE_GATT_MAX_MTU_SIZE];
+} relay_slot_t;
+
+/**@brief Forwarding queue and statistics of the relay.
+ *
+ * @details Slots are filled at in, handed to the SoftDevice at sent and freed at out, once their
+ *          TX_COMPLETE arrives. The indices run freely and are masked on use.
+ */
+typedef struct
+{
+	relay_slot_t	slots[RELAY_QUEUE_SIZE];
+	uint32_t		in;
+	uint32_t		sent;
+	uint32_t		out;
+	uint32_t		high_water;				//most slots in use at the same time
+	uint32_t		dropped;				//notifications lost because the queue was full or they did not fit downstream
+	uint64_t		bytes_in;
+	uint64_t		bytes_out;
+	uint64_t		first_ticks;			//arrival of the first notification of the transfer
+	uint64_t		last_ticks;				//TX_COMPLETE of the last notification sent on
+	uint64_t		queue_ticks_sum;		//arrival to hand-over to the SoftDevice
+	uint64_t		queue_ticks_max;
+	uint64_t		hop_ticks_sum;			//hand-over to TX_COMPLETE on the downstream link
+	uint64_t		hop_ticks_max;
+	uint32_t		fwd_cnt;				//notifications sent on in the current transfer
+} relay_t;
+
+static relay_t					m_relay;
 
 static bool volatile m_counter_started = false;
+static uint8_t       m_transfer_mode;          /**< Transfer mode of the running test, see transfer_mode_t. */
 static bool volatile m_run_test;
-static bool volatile m_print_menu;
-static bool volatile m_notif_enabled;
-static bool volatile m_mtu_exchanged;
-static bool volatile m_phy_updated;
-static bool volatile m_conn_interval_configured;
 static bool volatile m_test_started = false;
 static bool volatile m_test_continuous = false;
 
 static board_role_t volatile m_board_role  = NOT_SELECTED;
-static uint16_t              m_conn_handle = BLE_CONN_HANDLE_INVALID; /**< Handle of the current BLE connection .*/
-static uint8_t               m_gap_role    = BLE_GAP_ROLE_INVALID;    /**< BLE role for this connection, see @ref BLE_GAP_ROLES */
+
+static test_params_t      m_applied_params;      //parameters last passed to set_all_parameters(), the menu's or those of a sweep point
 
 static nrf_ble_gatt_t     m_gatt;                /**< GATT module instance. */
-static ble_db_discovery_t m_ble_db_discovery;    /**< Structure used to identify the DB Discovery module. */
 
 /* Name to use for advertising and connection. */
 static const char m_target_periph_name[] = DEVICE_NAME;
@@ -161,7 +436,6 @@ void advertising_start(void);
 void scan_start(void);
 void test_params_print(void);
 void display_test_params_print(void);
-uint8_t button_read(void);
 static void buttons_enable(void);
 void buttons_disable(void);
 static void wait_for_event(void);
@@ -183,6 +457,60 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
 }
 
 
+/**@brief Function for queueing an event for the main loop, from any interrupt priority.
+ *
+ * @details Redraws and stops are not queued twice, the one waiting covers all those before it.
+ */
+static void app_evt_put(app_evt_type_t type, uint8_t param)
+{
+	bool coalesce = (type == APP_EVT_DISPLAY_SHOW) || (type == APP_EVT_DISPLAY_TRANSFER) || (type == APP_EVT_TEST_STOP);
+	bool lost     = false;
+	
+	CRITICAL_REGION_ENTER();
+	if(!coalesce || !(m_app_evt_pending & (1 << type)))
+	{
+		if((m_app_evt_in - m_app_evt_out) < APP_EVT_QUEUE_SIZE)
+		{
+			m_app_evts[m_app_evt_in & (APP_EVT_QUEUE_SIZE - 1)].type  = type;
+			m_app_evts[m_app_evt_in & (APP_EVT_QUEUE_SIZE - 1)].param = param;
+			m_app_evt_in++;
+			m_app_evt_pending |= (1 << type);
+		}
+		else
+		{
+			lost = true;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+	
+	if(lost)
+	{
+		NRF_LOG_WARNING("Event queue full, event %u lost.\r\n", type);
+	}
+}
+
+/**@brief Function for taking the oldest event out of the queue.
+ *
+ * @return   false if the queue is empty.
+ */
+static bool app_evt_get(app_evt_t * p_evt)
+{
+	bool found = false;
+	
+	CRITICAL_REGION_ENTER();
+	if(m_app_evt_out != m_app_evt_in)
+	{
+		*p_evt = m_app_evts[m_app_evt_out & (APP_EVT_QUEUE_SIZE - 1)];
+		m_app_evt_out++;
+		m_app_evt_pending &= ~(1 << p_evt->type);
+		found = true;
+	}
+	CRITICAL_REGION_EXIT();
+	
+	return found;
+}
+
+
 /**@brief Function for the LEDs initialization.
  *
  * @details Initializes all LEDs used by the application.
@@ -225,6 +553,139 @@ static void gap_params_init(void)
 
 }
 
+/**@brief Function for finding the link of a connection.
+ *
+ * @details The SoftDevice does not promise to number its connections from 0, so the links are
+ *          searched by handle. There are at most LINK_CNT of them.
+ *
+ * @return   The link, or NULL if the connection handle is not in use.
+ */
+static link_ctx_t * link_get(uint16_t conn_handle)
+{
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		if((m_links[i].state != LINK_STATE_FREE) && (m_links[i].conn_handle == conn_handle))
+		{
+			return &m_links[i];
+		}
+	}
+	
+	return NULL;
+}
+
+/**@brief Function for setting up the link of a new connection.
+ *
+ * @details The AMT instances keep their configuration, only the connection state is reset.
+ *
+ * @return   The link, or NULL if all links are in use.
+ */
+static link_ctx_t * link_alloc(uint16_t conn_handle, uint8_t role)
+{
+	link_ctx_t * p_link = NULL;
+	
+	for(uint32_t i = 0; (i < LINK_CNT) && (p_link == NULL); i++)
+	{
+		if(m_links[i].state == LINK_STATE_FREE)
+		{
+			p_link = &m_links[i];
+		}
+	}
+	
+	if(p_link == NULL)
+	{
+		return NULL;
+	}
+	
+	p_link->conn_handle = conn_handle;
+	p_link->role        = role;
+	p_link->state       = LINK_STATE_SETUP;
+	p_link->setup_mask  = 0;
+	
+	memset(&p_link->transfer, 0, sizeof(p_link->transfer));
+	memset(&p_link->rssi, 0, sizeof(p_link->rssi));
+	p_link->rssi.max                  = -128;
+	p_link->rssi.range_multiplier_max = 500;
+	
+	return p_link;
+}
+
+/**@brief Function for recording a connection setup step of a link, which is ready once all are done. */
+static void link_setup_step_done(link_ctx_t * p_link, uint8_t step)
+{
+	p_link->setup_mask |= step;
+	
+	if((p_link->state == LINK_STATE_SETUP) && ((p_link->setup_mask & LINK_SETUP_ALL) == LINK_SETUP_ALL))
+	{
+		p_link->state = LINK_STATE_READY;
+	}
+}
+
+/**@brief Function for returning the number of links in a state. */
+static uint32_t links_in_state_cnt(link_state_t state)
+{
+	uint32_t cnt = 0;
+	
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		if(m_links[i].state == state)
+		{
+			cnt++;
+		}
+	}
+	
+	return cnt;
+}
+
+/**@brief Function for returning the number of connected links. */
+static uint32_t links_connected_cnt(void)
+{
+	return LINK_CNT - links_in_state_cnt(LINK_STATE_FREE);
+}
+
+/**@brief Function for returning the link shown on the display, the first one connected.
+ *
+ * @details Falls back to the first entry, which keeps the data of the last connection once all are closed.
+ */
+static link_ctx_t * link_display_get(void)
+{
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		if(m_links[i].state != LINK_STATE_FREE)
+		{
+			return &m_links[i];
+		}
+	}
+	
+	return &m_links[0];
+}
+
+/**@brief Function for returning the number of dummies the tester should connect to. */
+static uint32_t link_target_get(void)
+{
+	test_params_t test_params;
+	get_test_params(&test_params);
+	
+	if(test_params.link_cnt == 0)
+	{
+		return 1;
+	}
+	
+	return MIN(test_params.link_cnt, NRF_BLE_CENTRAL_LINK_COUNT);
+}
+
+/**@brief Function for ending a timed test, called from the RTC interrupt when the duration has elapsed.
+ */
+static void test_deadline_handler(void)
+{
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		if(m_links[i].state == LINK_STATE_RUNNING)
+		{
+			nrf_ble_amts_transfer_stop(&m_links[i].amts);
+		}
+	}
+}
+
 void test_run(bool wait_for_button)
 {
 	if(wait_for_button)
@@ -236,109 +697,1008 @@ void test_run(bool wait_for_button)
 		display_print_line_inc("Test is ready. Press any button to run.");
 		display_show();
 
-		(void) button_read();
+		// Run from the button handler.
+		m_ui_state = UI_STATE_TEST_READY;
+		return;
+	}
+	
+	test_params_t test_params;
+	get_test_params(&test_params);
+	
+	m_transfer_mode = test_params.transfer_mode;
+	
+	// The dummy decides when a write transfer ends, so only the tester's own transfers can be timed.
+	bool timed = (test_params.duration != 0) && (m_transfer_mode != TRANSFER_MODE_WRITE);
+	counter_deadline_set(timed ? ((uint64_t)test_params.duration * COUNTER_FREQ_HZ) : 0,
+						 test_deadline_handler);
+	
+	if((test_params.duration != 0) && !timed)
+	{
+		NRF_LOG_RAW_INFO("Write transfers can not be timed, sending %u KB.\r\n", test_params.transfer_data_size);
 	}
 	
+	// Write transfers are timed from the first write received, the others from the first TX_COMPLETE.
 	m_counter_started = false;
-    nrf_ble_amts_notif_spam(&m_amts);
+	if(m_transfer_mode == TRANSFER_MODE_INDICATION)
+	{
+		// Indications do not generate TX_COMPLETE, time from the first one sent.
+		NRF_LOG_RAW_INFO("Counter started\r\n");
+		counter_start();
+		m_counter_started = true;
+	}
+	
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		link_ctx_t * p_link = &m_links[i];
+		
+		// Finished links are run again in continuous mode.
+		if((p_link->state != LINK_STATE_READY) && (p_link->state != LINK_STATE_FINISHED))
+		{
+			continue;
+		}
+		
+		p_link->state             = LINK_STATE_RUNNING;
+		p_link->amts.payload_type = test_params.payload_type;
+		p_link->amts.timed        = timed;
+		
+		if(m_transfer_mode == TRANSFER_MODE_WRITE)
+		{
+			ret_code_t err_code = nrf_ble_amts_write_request(&p_link->amts, (uint32_t)amt_byte_transfer_count);
+			if(err_code != NRF_SUCCESS)
+			{
+				NRF_LOG_ERROR("nrf_ble_amts_write_request() returned 0x%x.\r\n", err_code);
+			}
+		}
+		else
+		{
+			// Ask the dummy to stream Write Without Response back while the notifications are running.
+			p_link->amts.notif_flags = (m_transfer_mode == TRANSFER_MODE_DUPLEX) ? AMT_NOTIF_FLAG_DUPLEX : 0;
+			p_link->amts.indicate    = (m_transfer_mode == TRANSFER_MODE_INDICATION);
+			p_link->amts.pace_rate   = p_link->amts.indicate ? 0 : ((uint32_t)test_params.pace_kbps * 1000 / 8);
+			
+			nrf_ble_amts_notif_spam(&p_link->amts);
+		}
+	}
+	
+	if((m_transfer_mode != TRANSFER_MODE_WRITE) && (m_transfer_mode != TRANSFER_MODE_INDICATION) && (test_params.pace_kbps != 0))
+	{
+		app_timer_start(m_pace_timer_id, PACE_TIMER_INTERVAL, NULL);
+	}
 	
 	m_test_started = true;
+	m_trace_cnt = 0;
+	m_trace_start_ticks = counter_now();
+	memset(&m_trace_progress, 0, sizeof(m_trace_progress));
+	memset(m_rssi_bins, 0, sizeof(m_rssi_bins));
+	memset(&m_rssi_bin_prev, 0, sizeof(m_rssi_bin_prev));
+	m_rssi_bin_prev_pkt_cnt = 0;
 	app_timer_start(m_display_timer_id, DISPLAY_TIMER_UPDATE_INTERVAL, NULL);
 }
 
 void terminate_test(void)
 {
     m_run_test                 = false;
-    m_notif_enabled            = false;
-    m_mtu_exchanged            = false;
-	m_phy_updated              = false;
-    m_conn_interval_configured = false;
 	m_test_started				= false;
 	
 	app_timer_stop(m_display_timer_id);
+	app_timer_stop(m_pace_timer_id);
 	
-    if (m_conn_handle != BLE_CONN_HANDLE_INVALID)
+	if (m_board_role == BOARD_TESTER)
+	{
+		// Still looking for more dummies.
+		(void) sd_ble_gap_scan_stop();
+	}
+	
+    if (links_connected_cnt() != 0)
     {
-        NRF_LOG_RAW_INFO("Disconnecting.\r\n");
-		
-        ret_code_t ret = sd_ble_gap_disconnect(m_conn_handle,
-            BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
-        if (ret != NRF_SUCCESS)
-        {
-            NRF_LOG_ERROR("Disconnected returned 0x%0x", ret);
-        }
+		for (uint32_t i = 0; i < LINK_CNT; i++)
+		{
+			link_ctx_t * p_link = &m_links[i];
+			
+			if ((p_link->state == LINK_STATE_FREE) || (p_link->state == LINK_STATE_DISCONNECTING))
+			{
+				continue;
+			}
+			
+			NRF_LOG_RAW_INFO("Disconnecting.\r\n");
+			
+			p_link->state = LINK_STATE_DISCONNECTING;
+			ret_code_t ret = sd_ble_gap_disconnect(p_link->conn_handle,
+				BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+			if (ret != NRF_SUCCESS)
+			{
+				NRF_LOG_ERROR("Disconnected returned 0x%0x", ret);
+			}
+		}
     }
     else
     {
         if (m_board_role == BOARD_TESTER)
         {
-            m_print_menu = true;
+			app_evt_put(m_sweep_active ? APP_EVT_SWEEP_NEXT : APP_EVT_MENU, 0);
         }
         if (m_board_role == BOARD_DUMMY)
         {
 			advertising_start();
         }
+        if (m_board_role == BOARD_RELAY)
+        {
+			// Whatever was not sent on is lost with the dummy.
+			memset(&m_relay, 0, sizeof(m_relay));
+			scan_start();
+        }
     }
 }
 
 
-/**@brief AMT Service Handler.
+static float ticks_to_ms(uint64_t ticks)
+{
+	return (float)ticks * 1000.0f / COUNTER_FREQ_HZ;
+}
+
+
+/**@brief Function for recording the time a connection setup milestone was reached.
+ *
+ * @details Only the first occurrence of each milestone is recorded. SETUP_START begins a new setup.
+ *          When the first packet has been sent the latencies are added to the statistics.
  */
-static void amts_evt_handler(nrf_ble_amts_evt_t evt)
+static void setup_milestone_set(setup_milestone_t milestone)
 {
-    ret_code_t  err_code;
-    switch (evt.evt_type)
-    {
-        case SERVICE_EVT_NOTIF_ENABLED:
-        {
-            bsp_board_led_on(LED_READY);
-            NRF_LOG_RAW_INFO("Notifications enabled.\r\n");
-			display_print_line_inc("Notifications enabled.");
-			m_display_show = true;
+	if(milestone == SETUP_START)
+	{
+		m_setup_mask = 0;
+	}
+	else if((m_setup_mask & (1UL << SETUP_START)) == 0)
+	{
+		return;
+	}
+	
+	if(m_setup_mask & (1UL << milestone))
+	{
+		return;
+	}
+	
+	m_setup_ticks[milestone] = counter_now();
+	m_setup_mask |= (1UL << milestone);
+	
+	if(milestone == SETUP_FIRST_TX_COMPLETE)
+	{
+		for(uint32_t i = SETUP_START + 1; i < SETUP_MILESTONE_CNT; i++)
+		{
+			if((m_setup_mask & (1UL << i)) == 0)
+			{
+				continue;
+			}
 			
-            m_notif_enabled = true;
-            if (m_board_role == BOARD_TESTER)
-            {
-				test_params_t test_params;
-				get_test_params(&test_params);
-				
-				m_conn_interval_configured     = true;
-				m_conn_param.min_conn_interval = MSEC_TO_UNITS(test_params.conn_interval, UNIT_1_25_MS);
-				m_conn_param.max_conn_interval = MSEC_TO_UNITS(test_params.conn_interval, UNIT_1_25_MS);
-				err_code = sd_ble_gap_conn_param_update(m_conn_handle,
-																   &m_conn_param);
-				if (err_code != NRF_SUCCESS)
-				{
-					NRF_LOG_ERROR("sd_ble_gap_conn_param_update returned 0x%x.\r\n", err_code);
-				}
+			setup_stats_t * p_stats = &m_setup_stats[i];
+			uint32_t latency = (uint32_t)(m_setup_ticks[i] - m_setup_ticks[SETUP_START]);
+			
+			p_stats->last = latency;
+			running_stats_add(&p_stats->ms, ticks_to_ms(latency));
+		}
+		
+		m_setup_report_pending = true;
+	}
+}
 
-            }
-        } break;
 
-        case SERVICE_EVT_NOTIF_DISABLED:
-            bsp_board_led_off(LED_READY);
-            NRF_LOG_RAW_INFO("Notifications disabled.\r\n");
-            break;
+/**@brief Function for printing the throughput statistics of the transfers run with the current parameters.
+ */
+static void throughput_stats_print(running_stats_t const * p_stats)
+{
+	if(p_stats->cnt < 2)
+	{
+		return;
+	}
+	
+	NRF_LOG_RAW_INFO("Throughput over %u transfers: mean " NRF_LOG_FLOAT_MARKER " +-" NRF_LOG_FLOAT_MARKER " Kbits/s (95%% CI).\r\n",
+					 p_stats->cnt,
+					 NRF_LOG_FLOAT(p_stats->mean),
+					 NRF_LOG_FLOAT(running_stats_ci95(p_stats)));
+	NRF_LOG_RAW_INFO("Stddev " NRF_LOG_FLOAT_MARKER ", min " NRF_LOG_FLOAT_MARKER ", max " NRF_LOG_FLOAT_MARKER " Kbits/s.\r\n",
+					 NRF_LOG_FLOAT(running_stats_stddev(p_stats)),
+					 NRF_LOG_FLOAT(p_stats->min),
+					 NRF_LOG_FLOAT(p_stats->max));
+}
 
-        case SERVICE_EVT_TRANSFER_1KB:
-        {
-            bsp_board_led_invert(LED_PROGRESS);
+
+/**@brief Function for printing the connection setup latency of the last connection and the statistics.
+ */
+static void setup_stats_print(void)
+{
+	NRF_LOG_RAW_INFO("Connection setup, ms since scan start (last, min/mean/max, stddev, 95%% CI of the mean):\r\n");
+	
+	for(uint32_t i = SETUP_START + 1; i < SETUP_MILESTONE_CNT; i++)
+	{
+		setup_stats_t const * p_stats = &m_setup_stats[i];
+		
+		if(p_stats->ms.cnt == 0)
+		{
+			continue;
+		}
+		
+		NRF_LOG_RAW_INFO("  %s: " NRF_LOG_FLOAT_MARKER, m_setup_milestone_str[i], NRF_LOG_FLOAT(ticks_to_ms(p_stats->last)));
+		NRF_LOG_RAW_INFO(" (" NRF_LOG_FLOAT_MARKER "/" NRF_LOG_FLOAT_MARKER "/" NRF_LOG_FLOAT_MARKER,
+						 NRF_LOG_FLOAT(p_stats->ms.min),
+						 NRF_LOG_FLOAT(p_stats->ms.mean),
+						 NRF_LOG_FLOAT(p_stats->ms.max));
+		NRF_LOG_RAW_INFO(", " NRF_LOG_FLOAT_MARKER ", +-" NRF_LOG_FLOAT_MARKER ", n=%u)\r\n",
+						 NRF_LOG_FLOAT(running_stats_stddev(&p_stats->ms)),
+						 NRF_LOG_FLOAT(running_stats_ci95(&p_stats->ms)),
+						 p_stats->ms.cnt);
+	}
+}
+
+
+/**@brief Function for getting the number of values a sweep takes for one parameter list.
+ */
+static uint16_t sweep_axis_len(uint8_t axis, uint16_t list_len)
+{
+	return (m_sweep_axis_mask & axis) ? list_len : 1;
+}
+
+
+/**@brief Function for getting the parameters of a sweep point.
+ *
+ * @details The point index is split into one index per varied parameter list, with the PHY changing
+ *          slowest and the TX power fastest. Parameters not covered by the sweep are taken from the
+ *          menu parameters saved when the sweep began.
+ */
+static void sweep_point_params_get(uint16_t point, test_params_t * p_params)
+{
+	*p_params = m_sweep_menu_params;
+	
+	if(m_sweep_axis_mask & SWEEP_AXIS_TX_POWER)
+	{
+		p_params->tx_power = m_sweep_tx_powers[point % ARRAY_SIZE(m_sweep_tx_powers)];
+		point /= ARRAY_SIZE(m_sweep_tx_powers);
+	}
+	
+	if(m_sweep_axis_mask & SWEEP_AXIS_CONN_EVT_LEN_EXT)
+	{
+		p_params->conn_evt_len_ext_enabled = m_sweep_conn_evt_len_ext[point % ARRAY_SIZE(m_sweep_conn_evt_len_ext)];
+		point /= ARRAY_SIZE(m_sweep_conn_evt_len_ext);
+	}
+	
+	if(m_sweep_axis_mask & SWEEP_AXIS_DATA_LEN_EXT)
+	{
+		p_params->data_len_ext_enabled = m_sweep_data_len_ext[point % ARRAY_SIZE(m_sweep_data_len_ext)];
+		point /= ARRAY_SIZE(m_sweep_data_len_ext);
+	}
+	
+	if(m_sweep_axis_mask & SWEEP_AXIS_ATT_MTU)
+	{
+		p_params->att_mtu = m_sweep_att_mtus[point % ARRAY_SIZE(m_sweep_att_mtus)];
+		point /= ARRAY_SIZE(m_sweep_att_mtus);
+	}
+	
+	if(m_sweep_axis_mask & SWEEP_AXIS_CONN_INTERVAL)
+	{
+		p_params->conn_interval = m_sweep_conn_intervals[point % ARRAY_SIZE(m_sweep_conn_intervals)];
+		point /= ARRAY_SIZE(m_sweep_conn_intervals);
+	}
+	
+	if(m_sweep_axis_mask & SWEEP_AXIS_PHY)
+	{
+		p_params->rxtx_phy = m_sweep_phys[point];
+	}
+}
+
+
+/**@brief Function for applying the parameters of the current sweep point and connecting to the peer.
+ */
+static void sweep_point_start(void)
+{
+	test_params_t test_params;
+	
+	sweep_point_params_get(m_sweep_point, &test_params);
+	set_all_parameters(&test_params);
+	
+	m_sweep_run = 0;
+	
+	NRF_LOG_RAW_INFO("Sweep point %u/%u.\r\n", m_sweep_point + 1, m_sweep_point_cnt);
+	test_begin(true);
+}
+
+
+/**@brief Function for adding the throughput of a finished transfer to the current sweep point.
+ */
+static void sweep_result_add(float throughput)
+{
+	sweep_result_t * p_result = &m_sweep_results[m_sweep_point];
+	
+	if((p_result->runs == 0) || (throughput < p_result->min))
+	{
+		p_result->min = throughput;
+	}
+	if(throughput > p_result->max)
+	{
+		p_result->max = throughput;
+	}
+	p_result->sum += throughput;
+	p_result->runs++;
+	
+	m_sweep_run++;
+	if((m_sweep_run < SWEEP_RUNS_PER_POINT) && !m_sweep_abort)
+	{
+		//run the next transfer on the same connection
+		m_run_test = false;
+	}
+	else
+	{
+		//disconnect, the next point is started when the link is down
+		terminate_test();
+	}
+}
+
+
+/**@brief Function for printing the sweep results as CSV.
+ */
+static void sweep_results_print(void)
+{
+	test_params_t const * p_menu_params = &m_sweep_menu_params;
+	
+	NRF_LOG_RAW_INFO("\r\nSweep axes: %s\r\n", sweep_axes_str(p_menu_params->sweep_axes));
+	NRF_LOG_RAW_INFO("Transfer mode: %s\r\n", transfer_mode_str(p_menu_params->transfer_mode));
+	if(p_menu_params->duration != 0)
+	{
+		NRF_LOG_RAW_INFO("Timed runs of %u s.\r\n", p_menu_params->duration);
+	}
+	if(p_menu_params->data_channels != 0)
+	{
+		NRF_LOG_RAW_INFO("Data channels: %u of %u.\r\n", p_menu_params->data_channels, BLE_DATA_CHANNEL_CNT);
+	}
+	if(link_target_get() > 1)
+	{
+		NRF_LOG_RAW_INFO("Aggregate of %u dummies.\r\n", link_target_get());
+	}
+	NRF_LOG_RAW_INFO("phy,conn_interval_ms,att_mtu,data_len_ext,conn_evt_len_ext,tx_power_dbm,"
+					 "runs,min_kbps,mean_kbps,max_kbps\r\n");
+	NRF_LOG_FLUSH();
+	
+	for(uint16_t i = 0; i < m_sweep_point_cnt; i++)
+	{
+		test_params_t test_params;
+		sweep_result_t const * p_result = &m_sweep_results[i];
+		float mean = (p_result->runs != 0) ? (p_result->sum / p_result->runs) : 0;
+		
+		sweep_point_params_get(i, &test_params);
+		
+		NRF_LOG_RAW_INFO("%s," NRF_LOG_FLOAT_MARKER ",%u,%u,%u,",
+						 phy_str(test_params.rxtx_phy),
+						 NRF_LOG_FLOAT(test_params.conn_interval),
+						 test_params.att_mtu,
+						 test_params.data_len_ext_enabled,
+						 test_params.conn_evt_len_ext_enabled);
+		NRF_LOG_RAW_INFO("%d,%u,", test_params.tx_power, p_result->runs);
+		NRF_LOG_RAW_INFO(NRF_LOG_FLOAT_MARKER "," NRF_LOG_FLOAT_MARKER "," NRF_LOG_FLOAT_MARKER "\r\n",
+						 NRF_LOG_FLOAT(p_result->min),
+						 NRF_LOG_FLOAT(mean),
+						 NRF_LOG_FLOAT(p_result->max));
+		NRF_LOG_FLUSH();
+	}
+}
+
+
+/**@brief Function for moving on to the next sweep point, or ending the sweep after the last one.
+ */
+static void sweep_next_point(void)
+{
+	m_sweep_point++;
+	
+	if((m_sweep_point < m_sweep_point_cnt) && !m_sweep_abort)
+	{
+		sweep_point_start();
+		return;
+	}
+	
+	m_sweep_active = false;
+	
+	// Back to the parameters of the menu, the last point left its own applied.
+	set_all_parameters(&m_sweep_menu_params);
+	
+	NRF_LOG_RAW_INFO("\033[2J\033[;H");
+	NRF_LOG_RAW_INFO("Sweep %s after %u of %u points.\r\n",
+					 m_sweep_abort ? "aborted" : "done", m_sweep_point, m_sweep_point_cnt);
+	sweep_results_print();
+	
+	display_clear();
+	display_print_line_inc("Sweep done, results printed as CSV.");
+	display_print_line_inc("Press any button to exit.");
+	display_show();
+	
+	m_ui_state = UI_STATE_SWEEP_DONE;
+}
+
+
+void sweep_begin(void)
+{
+	memset(m_sweep_results, 0, sizeof(m_sweep_results));
+	memset(m_setup_stats, 0, sizeof(m_setup_stats));
+	get_test_params(&m_sweep_menu_params);
+	
+	uint8_t axes = m_sweep_menu_params.sweep_axes;
+	m_sweep_axis_mask = m_sweep_axes_masks[(axes < ARRAY_SIZE(m_sweep_axes_masks)) ? axes : SWEEP_AXES_PHY_CONN_INTERVAL];
+	m_sweep_point_cnt = sweep_axis_len(SWEEP_AXIS_PHY,              ARRAY_SIZE(m_sweep_phys))
+					  * sweep_axis_len(SWEEP_AXIS_CONN_INTERVAL,    ARRAY_SIZE(m_sweep_conn_intervals))
+					  * sweep_axis_len(SWEEP_AXIS_ATT_MTU,          ARRAY_SIZE(m_sweep_att_mtus))
+					  * sweep_axis_len(SWEEP_AXIS_DATA_LEN_EXT,     ARRAY_SIZE(m_sweep_data_len_ext))
+					  * sweep_axis_len(SWEEP_AXIS_CONN_EVT_LEN_EXT, ARRAY_SIZE(m_sweep_conn_evt_len_ext))
+					  * sweep_axis_len(SWEEP_AXIS_TX_POWER,         ARRAY_SIZE(m_sweep_tx_powers));
+	
+	m_sweep_point  = 0;
+	m_sweep_abort  = false;
+	m_sweep_active = true;
+	
+	NRF_LOG_RAW_INFO("Starting parameter sweep of %s, %u points, %u transfers each.\r\n",
+					 sweep_axes_str(axes), m_sweep_point_cnt, SWEEP_RUNS_PER_POINT);
+	if((m_sweep_menu_params.duration != 0) && (m_sweep_menu_params.transfer_mode != TRANSFER_MODE_WRITE))
+	{
+		uint32_t point_s = SWEEP_SETUP_S + SWEEP_RUNS_PER_POINT * m_sweep_menu_params.duration;
+		NRF_LOG_RAW_INFO("Expected run time about %u min.\r\n", (m_sweep_point_cnt * point_s + 59) / 60);
+	}
+	else
+	{
+		NRF_LOG_RAW_INFO("Runs are bounded by size, a slow point can take an hour. Set a test duration to bound the sweep.\r\n");
+	}
+	
+	sweep_point_start();
+}
+
+
+/**@brief Function for printing the packets per connection event statistics of the last transfer.
+ */
+static void tx_stats_print(nrf_ble_amts_tx_stats_t const * p_stats)
+{
+	if(p_stats->evt_cnt == 0)
+	{
+		return;
+	}
+	
+	NRF_LOG_RAW_INFO("Packets per TX complete event: min %u, mean " NRF_LOG_FLOAT_MARKER ", max %u.\r\n",
+				 p_stats->min,
+				 NRF_LOG_FLOAT((float)p_stats->pkt_cnt / (float)p_stats->evt_cnt),
+				 p_stats->max);
+	
+	for(uint32_t i = 0; i < AMTS_TX_COMPLETE_HIST_SIZE; i++)
+	{
+		if(p_stats->hist[i] != 0)
+		{
+			NRF_LOG_RAW_INFO("  %2u%s packets: %u events\r\n",
+						 i, (i == AMTS_TX_COMPLETE_HIST_SIZE - 1) ? "+" : " ", p_stats->hist[i]);
+		}
+	}
+}
+
+
+/**@brief Function for printing the throughput of the last transfer without its ramp-up and tail.
+ */
+static void steady_state_print(nrf_ble_amts_t const * p_amts)
+{
+	uint64_t bytes;
+	uint64_t ticks;
+	
+	if((nrf_ble_amts_steady_window_get(p_amts, STEADY_STATE_TRIM_PERCENT, &bytes, &ticks) != NRF_SUCCESS)
+	   || (ticks == 0))
+	{
+		NRF_LOG_RAW_INFO("Transfer too short for a steady state throughput.\r\n");
+		return;
+	}
+	
+	float throughput = (float)(bytes * 8 * COUNTER_FREQ_HZ) / (float)ticks / 1000.0f;
+	
+	NRF_LOG_RAW_INFO("Steady state (middle %u%%): " NRF_LOG_FLOAT_MARKER " Kbits/s over " NRF_LOG_FLOAT_MARKER " seconds.\r\n",
+				 100 - (2 * STEADY_STATE_TRIM_PERCENT),
+				 NRF_LOG_FLOAT(throughput),
+				 NRF_LOG_FLOAT((float)ticks / COUNTER_FREQ_HZ));
+}
+
+
+/**@brief Function for printing the throughput trace of the last run as CSV, oldest sample first.
+ */
+static void trace_print(void)
+{
+	uint32_t         first = 0;
+	uint32_t         cnt   = m_trace_cnt;
+	trace_progress_t total = m_trace_progress;
+	
+	if(m_trace_cnt > TRACE_SAMPLE_CNT)
+	{
+		first = m_trace_cnt % TRACE_SAMPLE_CNT;
+		cnt   = TRACE_SAMPLE_CNT;
+		NRF_LOG_RAW_INFO("Trace: first %u samples overwritten.\r\n", m_trace_cnt - TRACE_SAMPLE_CNT);
+	}
+	
+	// Wind the totals back to before the oldest sample kept.
+	for(uint32_t i = 0; i < cnt; i++)
+	{
+		trace_sample_t const * p_sample = &m_trace[(first + i) % TRACE_SAMPLE_CNT];
+		
+		total.ticks           -= p_sample->ticks;
+		total.bytes           -= p_sample->bytes;
+		total.tx_complete_cnt -= p_sample->tx_complete_cnt;
+	}
+	
+	NRF_LOG_RAW_INFO("time_ms,bytes,rssi_dbm,tx_complete_evts\r\n");
+	NRF_LOG_FLUSH();
+	
+	for(uint32_t i = 0; i < cnt; i++)
+	{
+		trace_sample_t const * p_sample = &m_trace[(first + i) % TRACE_SAMPLE_CNT];
+		
+		total.ticks           += p_sample->ticks;
+		total.bytes           += p_sample->bytes;
+		total.tx_complete_cnt += p_sample->tx_complete_cnt;
+		
+		char bytes_str[21];
+		NRF_LOG_RAW_INFO("%u,%s,%d,%u\r\n",
+						 (uint32_t)(counter_ticks_to_us(total.ticks) / 1000),
+						 nrf_log_push(uint64_to_str(total.bytes, bytes_str)),
+						 p_sample->rssi,
+						 total.tx_complete_cnt);
+		NRF_LOG_FLUSH();
+	}
+}
+
+
+/**@brief Function for printing the transfer progress per RSSI bin of the last run.
+ */
+static void rssi_bins_print(void)
+{
+	NRF_LOG_RAW_INFO("Link quality by RSSI:\r\n");
+	NRF_LOG_RAW_INFO("rssi_dbm,periods,stalls,kbps,pkts_per_tx_complete\r\n");
+	NRF_LOG_FLUSH();
+	
+	for(uint32_t i = 0; i < RSSI_BIN_CNT; i++)
+	{
+		rssi_bin_t const * p_bin = &m_rssi_bins[i];
+		
+		if((p_bin->periods == 0) || (p_bin->ticks == 0))
+		{
+			continue;
+		}
+		
+		float kbps = (float)(p_bin->bytes * 8 * COUNTER_FREQ_HZ) / (float)p_bin->ticks / 1000.0f;
+		float pkts = (p_bin->tx_complete_cnt == 0) ? 0.0f : ((float)p_bin->pkt_cnt / (float)p_bin->tx_complete_cnt);
+		
+		NRF_LOG_RAW_INFO("%d,%u,%u,",
+						 RSSI_BIN_MIN_DBM + (int32_t)(i * RSSI_BIN_DB),
+						 p_bin->periods,
+						 p_bin->stalls);
+		NRF_LOG_RAW_INFO(NRF_LOG_FLOAT_MARKER "," NRF_LOG_FLOAT_MARKER "\r\n",
+						 NRF_LOG_FLOAT(kbps),
+						 NRF_LOG_FLOAT(pkts));
+		NRF_LOG_FLUSH();
+	}
+}
+
+
+/**@brief Function for printing the indication round-trip times of the last transfer.
+ */
+static void rtt_stats_print(nrf_ble_amts_rtt_stats_t const * p_stats)
+{
+	if(p_stats->cnt == 0)
+	{
+		return;
+	}
+	
+	NRF_LOG_RAW_INFO("Indication round trip over %u indications, in us:\r\n", p_stats->cnt);
+	NRF_LOG_RAW_INFO("  min %u, mean %u\r\n",
+				 (uint32_t)counter_ticks_to_us(p_stats->min),
+				 (uint32_t)counter_ticks_to_us(p_stats->sum / p_stats->cnt));
+	NRF_LOG_RAW_INFO("  p50 %u, p90 %u, p99 %u, max %u\r\n",
+				 (uint32_t)counter_ticks_to_us(nrf_ble_amts_rtt_percentile_get(p_stats, 50)),
+				 (uint32_t)counter_ticks_to_us(nrf_ble_amts_rtt_percentile_get(p_stats, 90)),
+				 (uint32_t)counter_ticks_to_us(nrf_ble_amts_rtt_percentile_get(p_stats, 99)),
+				 (uint32_t)counter_ticks_to_us(p_stats->max));
+}
+
+
+/**@brief Function for checking whether the transfers on all connected links have ended.
+ */
+static bool links_finished(void)
+{
+	return (links_in_state_cnt(LINK_STATE_RUNNING) == 0);
+}
+
+
+/**@brief Function for computing the throughput of the last transfer on one link, in kbps.
+ */
+static float link_throughput_get(link_ctx_t const * p_link)
+{
+	if(p_link->transfer.counter_ticks == 0)
+	{
+		return 0.0f;
+	}
+	
+	return (float)(p_link->transfer.bytes_transfered * 8 * COUNTER_FREQ_HZ) / (float)p_link->transfer.counter_ticks / 1000.0f;
+}
+
+
+/**@brief Function for printing the details of the last transfer on one link.
+ */
+static void link_report_print(link_ctx_t const * p_link, nrf_ble_amts_evt_type_t evt_type)
+{
+	nrf_ble_amts_t const * p_amts = &p_link->amts;
+	
+	if((m_transfer_mode == TRANSFER_MODE_DUPLEX) && (p_link->transfer.counter_ticks != 0))
+	{
+		char bytes_str[21];
+		float throughput = link_throughput_get(p_link);
+		uint64_t rcvd_cnt = p_amts->bytes_rcvd - p_link->duplex_rcvd_start;
+		float rcvd_throughput = (float)(rcvd_cnt * 8 * COUNTER_FREQ_HZ) / (float)p_link->transfer.counter_ticks;
+		rcvd_throughput = rcvd_throughput / (float)1000;
+		
+		NRF_LOG_RAW_INFO("Received %s bytes of Write Without Response.\r\n",
+					 nrf_log_push(uint64_to_str(rcvd_cnt, bytes_str)));
+		NRF_LOG_RAW_INFO("Tester->dummy: " NRF_LOG_FLOAT_MARKER " Kbits/s.\r\n",
+					 NRF_LOG_FLOAT(throughput));
+		NRF_LOG_RAW_INFO("Dummy->tester: " NRF_LOG_FLOAT_MARKER " Kbits/s.\r\n",
+					 NRF_LOG_FLOAT(rcvd_throughput));
+		NRF_LOG_RAW_INFO("Aggregate: " NRF_LOG_FLOAT_MARKER " Kbits/s.\r\n",
+					 NRF_LOG_FLOAT(throughput + rcvd_throughput));
+	}
+	
+	if((evt_type == SERVICE_EVT_WRITE_FINISHED) || (m_transfer_mode == TRANSFER_MODE_DUPLEX))
+	{
+		NRF_LOG_RAW_INFO("Corrupted writes: %u.\r\n", p_amts->write_corrupt_cnt);
+	}
+	
+	steady_state_print(p_amts);
+	
+	if((evt_type == SERVICE_EVT_TRANSFER_FINISHED) && (p_amts->pace_rate != 0))
+	{
+		NRF_LOG_RAW_INFO("Paced at %u kbps, deepest backlog %u bytes.\r\n",
+					 p_amts->pace_rate * 8 / 1000, p_amts->pace_backlog_max);
+	}
+	
+	if(m_transfer_mode == TRANSFER_MODE_INDICATION)
+	{
+		rtt_stats_print(&p_amts->rtt_stats);
+	}
+	else if(evt_type == SERVICE_EVT_TRANSFER_FINISHED)
+	{
+		tx_stats_print(&p_amts->tx_stats);
+	}
+}
+
+
+/**@brief Function for printing how evenly the throughput was shared between the links.
+ *
+ * @details Uses Jain's fairness index, (sum x)^2 / (n * sum x^2), which is 1 when all links got the
+ *          same throughput and 1/n when one link got all of it.
+ */
+static void links_fairness_print(void)
+{
+	float    sum    = 0.0f;
+	float    sum_sq = 0.0f;
+	uint32_t cnt    = 0;
+	
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		if(m_links[i].state == LINK_STATE_FINISHED)
+		{
+			float throughput = m_links[i].transfer.last_throughput;
+			
+			sum    += throughput;
+			sum_sq += throughput * throughput;
+			cnt++;
+		}
+	}
+	
+	if((cnt == 0) || (sum_sq == 0.0f))
+	{
+		return;
+	}
+	
+	NRF_LOG_RAW_INFO("\r\n%u links, " NRF_LOG_FLOAT_MARKER " Kbits/s in total, fairness index " NRF_LOG_FLOAT_MARKER ".\r\n",
+				 cnt,
+				 NRF_LOG_FLOAT(sum),
+				 NRF_LOG_FLOAT((sum * sum) / ((float)cnt * sum_sq)));
+}
+
+
+/**@brief Function for returning the connected link of the relay in a GAP role.
+ *
+ * @details The relay is the peripheral of the tester upstream and the central of the dummy downstream.
+ */
+static link_ctx_t * relay_link_get(uint8_t role)
+{
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		if((m_links[i].state != LINK_STATE_FREE) && (m_links[i].role == role))
+		{
+			return &m_links[i];
+		}
+	}
+	
+	return NULL;
+}
+
+/**@brief Function for clearing the statistics of the relay at the start of a transfer, keeping the queue. */
+static void relay_stats_reset(void)
+{
+	m_relay.high_water      = m_relay.in - m_relay.out;
+	m_relay.dropped         = 0;
+	m_relay.bytes_in        = 0;
+	m_relay.bytes_out       = 0;
+	m_relay.first_ticks     = counter_now();
+	m_relay.last_ticks      = m_relay.first_ticks;
+	m_relay.queue_ticks_sum = 0;
+	m_relay.queue_ticks_max = 0;
+	m_relay.hop_ticks_sum   = 0;
+	m_relay.hop_ticks_max   = 0;
+	m_relay.fwd_cnt         = 0;
+}
+
+/**@brief Function for printing the statistics of a relayed transfer.
+ *
+ * @details The hop from the tester can only be timed on the tester, the relay has no common clock with it.
+ */
+static void relay_report_print(void)
+{
+	uint64_t window_ticks = m_relay.last_ticks - m_relay.first_ticks;
+	
+	if((window_ticks == 0) || (m_relay.fwd_cnt == 0))
+	{
+		return;
+	}
+	
+	float throughput = (float)(m_relay.bytes_out * 8 * COUNTER_FREQ_HZ) / (float)window_ticks / 1000.0f;
+	
+	char in_str[21];
+	char out_str[21];
+	NRF_LOG_RAW_INFO("Relay done, forwarded %s of %s bytes, %u notifications dropped.\r\n",
+				 nrf_log_push(uint64_to_str(m_relay.bytes_out, out_str)),
+				 nrf_log_push(uint64_to_str(m_relay.bytes_in, in_str)),
+				 m_relay.dropped);
+	NRF_LOG_RAW_INFO("End-to-end throughput " NRF_LOG_FLOAT_MARKER " Kbits/s.\r\n", NRF_LOG_FLOAT(throughput));
+	NRF_LOG_RAW_INFO("Queue high-water mark %u of %u notifications.\r\n", m_relay.high_water, RELAY_QUEUE_SIZE);
+	NRF_LOG_RAW_INFO("Queueing: mean %u us, max %u us.\r\n",
+				 (uint32_t)counter_ticks_to_us(m_relay.queue_ticks_sum / m_relay.fwd_cnt),
+				 (uint32_t)counter_ticks_to_us(m_relay.queue_ticks_max));
+	NRF_LOG_RAW_INFO("Downstream hop: mean %u us, max %u us.\r\n",
+				 (uint32_t)counter_ticks_to_us(m_relay.hop_ticks_sum / m_relay.fwd_cnt),
+				 (uint32_t)counter_ticks_to_us(m_relay.hop_ticks_max));
+}
+
+/**@brief Function for sending the queued notifications on to the dummy, until its TX buffers are full.
+ */
+static void relay_drain(void)
+{
+	link_ctx_t * p_down = relay_link_get(BLE_GAP_ROLE_CENTRAL);
+	if(p_down == NULL)
+	{
+		return;
+	}
+	
+	while(m_relay.sent != m_relay.in)
+	{
+		relay_slot_t * p_slot = &m_relay.slots[m_relay.sent & (RELAY_QUEUE_SIZE - 1)];
+		
+		ret_code_t err_code = nrf_ble_amts_notif_forward(&p_down->amts, p_slot->data, p_slot->len);
+		if(err_code == NRF_ERROR_BUSY)
+		{
+			// Resumed on SERVICE_EVT_TX_READY.
+			break;
+		}
+		else if(err_code != NRF_SUCCESS)
+		{
+			NRF_LOG_ERROR("nrf_ble_amts_notif_forward() returned 0x%x.\r\n", err_code);
+			break;
+		}
+		
+		p_slot->sent_ticks = (uint32_t)counter_now();
+		
+		uint32_t queue_ticks = p_slot->sent_ticks - p_slot->rcvd_ticks;
+		m_relay.queue_ticks_sum += queue_ticks;
+		m_relay.queue_ticks_max  = MAX(m_relay.queue_ticks_max, queue_ticks);
+		m_relay.sent++;
+	}
+}
+
+/**@brief Function for queueing a notification received from the tester, to be sent on to the dummy.
+ */
+static void relay_notif_push(nrf_ble_amtc_evt_t const * p_evt)
+{
+	link_ctx_t * p_up = link_get(p_evt->conn_handle);
+	if((p_up == NULL) || (p_up->role != BLE_GAP_ROLE_PERIPH))
+	{
+		return;
+	}
+	
+	// The end marker of a timed transfer is reported without length, it is a bare header.
+	uint16_t len = (p_evt->params.hvx.notif_len != 0) ? p_evt->params.hvx.notif_len : AMT_NOTIF_HDR_LEN;
+	
+	if(p_evt->params.hvx.transfer_start)
+	{
+		relay_stats_reset();
+	}
+	
+	m_relay.bytes_in += p_evt->params.hvx.notif_len;
+	
+	link_ctx_t * p_down = relay_link_get(BLE_GAP_ROLE_CENTRAL);
+	if(   (p_down == NULL)
+	   || (len > p_down->amts.max_payload_len)
+	   || ((m_relay.in - m_relay.out) == RELAY_QUEUE_SIZE))
+	{
+		m_relay.dropped++;
+		return;
+	}
+	
+	relay_slot_t * p_slot = &m_relay.slots[m_relay.in & (RELAY_QUEUE_SIZE - 1)];
+	
+	p_slot->rcvd_ticks = (uint32_t)counter_now();
+	p_slot->len        = len;
+	memcpy(p_slot->data, p_evt->params.hvx.p_data, len);
+	
+	m_relay.in++;
+	m_relay.high_water = MAX(m_relay.high_water, m_relay.in - m_relay.out);
+	
+	relay_drain();
+}
+
+/**@brief Function for freeing the relay slots sent to the dummy, on TX_COMPLETE of the downstream link.
+ *
+ * @details The received byte count of the tester is set to the bytes delivered to the dummy.
+ */
+static void relay_tx_complete(uint8_t count)
+{
+	bool     last      = false;
+	uint64_t kbyte_cnt = m_relay.bytes_out / 1024;
+	
+	for(; (count > 0) && (m_relay.out != m_relay.sent); count--)
+	{
+		relay_slot_t * p_slot = &m_relay.slots[m_relay.out & (RELAY_QUEUE_SIZE - 1)];
+		uint64_t       now    = counter_now();
+		uint32_t       hop    = (uint32_t)now - p_slot->sent_ticks;
+		
+		m_relay.hop_ticks_sum += hop;
+		m_relay.hop_ticks_max  = MAX(m_relay.hop_ticks_max, hop);
+		m_relay.last_ticks     = now;
+		m_relay.fwd_cnt++;
+		
+		// A bare header carries no data.
+		if(p_slot->len > AMT_NOTIF_HDR_LEN)
+		{
+			m_relay.bytes_out += p_slot->len;
+		}
+		
+		last = last || (p_slot->data[4] & AMT_NOTIF_FLAG_LAST);
+		m_relay.out++;
+	}
+	
+	link_ctx_t * p_up = relay_link_get(BLE_GAP_ROLE_PERIPH);
+	if((p_up != NULL) && (last || ((m_relay.bytes_out / 1024) != kbyte_cnt)))
+	{
+		bsp_board_led_invert(LED_PROGRESS);
+		nrf_ble_amts_rbc_set(&p_up->amts, m_relay.bytes_out);
+	}
+	
+	if(last)
+	{
+		bsp_board_led_off(LED_PROGRESS);
+		relay_report_print();
+	}
+}
+
+
+/**@brief AMT Service Handler.
+ */
+static void amts_evt_handler(nrf_ble_amts_evt_t evt)
+{
+    ret_code_t  err_code;
+    switch (evt.evt_type)
+    {
+        case SERVICE_EVT_NOTIF_ENABLED:
+        {
+			setup_milestone_set(SETUP_CCCD_WRITTEN);
+
+            bsp_board_led_on(LED_READY);
+            NRF_LOG_RAW_INFO("Notifications enabled.\r\n");
+			display_print_line_inc("Notifications enabled.");
+			app_evt_put(APP_EVT_DISPLAY_SHOW, 0);
+			
+			link_ctx_t * p_link = link_get(evt.conn_handle);
+			if (p_link == NULL)
+			{
+				break;
+			}
+			
+            link_setup_step_done(p_link, LINK_SETUP_NOTIF_ENABLED);
+            if (p_link->role == BLE_GAP_ROLE_CENTRAL)
+            {
+				link_setup_step_done(p_link, LINK_SETUP_CONN_PARAMS);
+				m_conn_param.min_conn_interval = MSEC_TO_UNITS(m_applied_params.conn_interval, UNIT_1_25_MS);
+				m_conn_param.max_conn_interval = MSEC_TO_UNITS(m_applied_params.conn_interval, UNIT_1_25_MS);
+				err_code = sd_ble_gap_conn_param_update(evt.conn_handle,
+																   &m_conn_param);
+				if (err_code != NRF_SUCCESS)
+				{
+					NRF_LOG_ERROR("sd_ble_gap_conn_param_update returned 0x%x.\r\n", err_code);
+				}
+				
+				// The relay has somewhere to send the notifications to, let the tester find it.
+				if ((m_board_role == BOARD_RELAY) && (relay_link_get(BLE_GAP_ROLE_PERIPH) == NULL))
+				{
+					NRF_LOG_RAW_INFO("Dummy attached, waiting for the tester.\r\n");
+					advertising_start();
+				}
+            }
+        } break;
+
+        case SERVICE_EVT_NOTIF_DISABLED:
+            bsp_board_led_off(LED_READY);
+            NRF_LOG_RAW_INFO("Notifications disabled.\r\n");
+            break;
+
+        case SERVICE_EVT_TRANSFER_1KB:
+        {
+            bsp_board_led_invert(LED_PROGRESS);
 			
         } break;
 
+        case SERVICE_EVT_TX_READY:
+			if (m_board_role == BOARD_RELAY)
+			{
+				relay_drain();
+			}
+			break;
+
+        case SERVICE_EVT_WRITE_STARTED:
+			// Time all links from the first write received.
+			if(!m_counter_started)
+			{
+				NRF_LOG_RAW_INFO("Counter started\r\n");
+				counter_start();
+				m_counter_started = true;
+			}
+			break;
+
         case SERVICE_EVT_TRANSFER_FINISHED:
+        case SERVICE_EVT_WRITE_FINISHED:
         {
+			link_ctx_t * p_link = link_get(evt.conn_handle);
+			if((p_link == NULL) || (p_link->state != LINK_STATE_RUNNING))
+			{
+				break;
+			}
+			
+			p_link->state                     = LINK_STATE_FINISHED;
+			p_link->transfer.bytes_transfered = evt.bytes_transfered_cnt;
+			p_link->transfer.counter_ticks    = counter_get();
+			p_link->transfer.last_throughput  = link_throughput_get(p_link);
+			
+			// Report once the transfers on all links have ended.
+			if(!links_finished())
+			{
+				break;
+			}
+			
 			counter_stop();
+			app_timer_stop(m_pace_timer_id);
 			
             bsp_board_led_off(LED_PROGRESS);
             //bsp_board_led_on(LED_FINISHED);
 			
-			uint32_t counter_ticks = counter_get();
+			uint64_t counter_ticks = counter_get();
+			uint64_t bytes_cnt     = 0;
+			uint32_t link_cnt      = 0;
+			
+			for(uint32_t i = 0; i < LINK_CNT; i++)
+			{
+				if(m_links[i].state == LINK_STATE_FINISHED)
+				{
+					bytes_cnt += m_links[i].transfer.bytes_transfered;
+					link_cnt++;
+				}
+			}
+			
 			m_transfer_data.counter_ticks = counter_ticks;
-			m_transfer_data.bytes_transfered = evt.bytes_transfered_cnt;
+			m_transfer_data.bytes_transfered = bytes_cnt;
 			
-			float sent_octet_cnt = evt.bytes_transfered_cnt * 8;
-			float throughput = (float)(sent_octet_cnt * 32768) / (float)counter_ticks;
+			float sent_octet_cnt = bytes_cnt * 8;
+			float throughput = (float)(sent_octet_cnt * COUNTER_FREQ_HZ) / (float)counter_ticks;
 			throughput = throughput / (float)1000;
 			
             NRF_LOG_RAW_INFO("\033[30;0H");	//move cursor to correct position
@@ -346,21 +1706,83 @@ static void amts_evt_handler(nrf_ble_amts_evt_t evt)
 			
 			NRF_LOG_RAW_INFO("Test done\r\n");
             NRF_LOG_RAW_INFO("Time: " NRF_LOG_FLOAT_MARKER " seconds elapsed.\r\n",
-                         NRF_LOG_FLOAT((float)counter_ticks / 32768));
-            NRF_LOG_RAW_INFO("Throughput: " NRF_LOG_FLOAT_MARKER " Kbits/s.\r\n",
+                         NRF_LOG_FLOAT((float)counter_ticks / COUNTER_FREQ_HZ));
+            NRF_LOG_RAW_INFO("%s: " NRF_LOG_FLOAT_MARKER " Kbits/s.\r\n",
+                         (m_transfer_mode == TRANSFER_MODE_INDICATION) ? (uint32_t)"Acknowledged throughput" : (uint32_t)"Throughput",
                          NRF_LOG_FLOAT(throughput));
-            NRF_LOG_RAW_INFO("Sent %u bytes of ATT payload.\r\n", evt.bytes_transfered_cnt);
+            char bytes_str[21];
+			if(evt.evt_type == SERVICE_EVT_WRITE_FINISHED)
+			{
+				NRF_LOG_RAW_INFO("Received %s bytes of Write Without Response.\r\n",
+							 nrf_log_push(uint64_to_str(bytes_cnt, bytes_str)));
+			}
+			else if(p_link->amts.timed)
+			{
+				// Data still queued at the deadline is not counted.
+				NRF_LOG_RAW_INFO("Delivered %s bytes of ATT payload by the deadline.\r\n",
+							 nrf_log_push(uint64_to_str(bytes_cnt, bytes_str)));
+			}
+			else
+			{
+				NRF_LOG_RAW_INFO("Sent %s bytes of ATT payload.\r\n",
+							 nrf_log_push(uint64_to_str(bytes_cnt, bytes_str)));
+			}
+			
+			for(uint32_t i = 0; i < LINK_CNT; i++)
+			{
+				if(m_links[i].state != LINK_STATE_FINISHED)
+				{
+					continue;
+				}
+				
+				if(link_cnt > 1)
+				{
+					NRF_LOG_RAW_INFO("\r\nLink %u: %s bytes, " NRF_LOG_FLOAT_MARKER " Kbits/s.\r\n",
+								 i,
+								 nrf_log_push(uint64_to_str(m_links[i].transfer.bytes_transfered, bytes_str)),
+								 NRF_LOG_FLOAT(m_links[i].transfer.last_throughput));
+				}
+				
+				link_report_print(&m_links[i], evt.evt_type);
+			}
+			
+			if(link_cnt > 1)
+			{
+				links_fairness_print();
+			}
+			
+			if(m_setup_report_pending)
+			{
+				m_setup_report_pending = false;
+				setup_stats_print();
+			}
+			
+			// The sweep prints its own CSV, keep it readable. The dump is too long for the
+			// SoftDevice interrupt, it is printed from the main loop.
+			if(!m_sweep_active)
+			{
+				app_evt_put(APP_EVT_TRACE_PRINT, 0);
+			}
 			
 			m_transfer_data.last_throughput = throughput;
 			
-			if(m_test_continuous)
+			if(!m_sweep_active)
+			{
+				running_stats_add(&m_transfer_data.throughput_stats, throughput);
+				throughput_stats_print(&m_transfer_data.throughput_stats);
+			}
+			
+			if(m_sweep_active)
+			{
+				sweep_result_add(throughput);
+			}
+			else if(m_test_continuous)
 			{
 				m_run_test = false;
 			}
 			else
 			{
-				m_transfer_done = true;
-				m_display_show_transfer_data = false;
+				app_evt_put(APP_EVT_TRANSFER_DONE, 0);
 				terminate_test();
 			}
 
@@ -369,6 +1791,27 @@ static void amts_evt_handler(nrf_ble_amts_evt_t evt)
 }
 
 
+/**@brief Function for printing the arrival statistics of a paced transfer, on the receiving side.
+ */
+static void arrival_stats_print(nrf_ble_amtc_arrival_stats_t const * p_stats, uint64_t bytes_rcvd)
+{
+	uint64_t window_ticks = p_stats->last_ticks - p_stats->first_ticks;
+	
+	if((window_ticks == 0) || (p_stats->gap_cnt < 2))
+	{
+		return;
+	}
+	
+	float rate = (float)(bytes_rcvd * 8 * COUNTER_FREQ_HZ) / (float)window_ticks / 1000.0f;
+	
+	NRF_LOG_RAW_INFO("Achieved rate " NRF_LOG_FLOAT_MARKER " kbps.\r\n", NRF_LOG_FLOAT(rate));
+	NRF_LOG_RAW_INFO("Inter-arrival: mean %u us, max %u us, jitter %u us.\r\n",
+				 (uint32_t)counter_ticks_to_us(window_ticks / p_stats->gap_cnt),
+				 (uint32_t)counter_ticks_to_us(p_stats->gap_max),
+				 (uint32_t)counter_ticks_to_us(p_stats->jitter_sum / (p_stats->gap_cnt - 1)));
+}
+
+
 /**@brief AMT Client Handler.
  */
 void amtc_evt_handler(nrf_ble_amtc_t * p_amt_c, nrf_ble_amtc_evt_t * p_evt)
@@ -379,6 +1822,8 @@ void amtc_evt_handler(nrf_ble_amtc_t * p_amt_c, nrf_ble_amtc_evt_t * p_evt)
     {
         case NRF_BLE_AMT_C_EVT_DISCOVERY_COMPLETE:
         {
+			setup_milestone_set(SETUP_DB_DISCOVERED);
+
             NRF_LOG_RAW_INFO("AMT service discovered on the peer.\r\n");
 			
             err_code = nrf_ble_amtc_handles_assign(p_amt_c ,
@@ -393,13 +1838,25 @@ void amtc_evt_handler(nrf_ble_amtc_t * p_amt_c, nrf_ble_amtc_evt_t * p_evt)
 
         case NRF_BLE_AMT_C_EVT_NOTIFICATION:
         {
+            if (m_board_role == BOARD_RELAY)
+            {
+                relay_notif_push(p_evt);
+                break;
+            }
+
             static uint32_t bytes_cnt  = 0;
             static uint32_t kbytes_cnt = 0;
+            static bool     complete   = false;
+
+            // The received byte count is reported through the server of the same link.
+            link_ctx_t     * p_link = link_get(p_evt->conn_handle);
+            nrf_ble_amts_t * p_amts = (p_link != NULL) ? &p_link->amts : &m_links[0].amts;
 
-            if (p_evt->params.hvx.bytes_sent == 0)
+            if (p_evt->params.hvx.transfer_start)
             {
                 bytes_cnt  = 0;
                 kbytes_cnt = 0;
+                complete   = false;
             }
 
             bytes_cnt += p_evt->params.hvx.notif_len;
@@ -416,32 +1873,100 @@ void amtc_evt_handler(nrf_ble_amtc_t * p_amt_c, nrf_ble_amtc_evt_t * p_evt)
 					NRF_LOG_RAW_INFO("Received %u kbytes\r\n", kbytes_cnt);
 				}
 
-                nrf_ble_amts_rbc_set(&m_amts, p_evt->params.hvx.bytes_rcvd);
+                nrf_ble_amts_rbc_set(p_amts, p_evt->params.hvx.bytes_rcvd);
             }
 
             NRF_LOG_DEBUG("AMT Notification bytes cnt %u\r\n", p_evt->params.hvx.bytes_sent);
 
-            if (p_evt->params.hvx.bytes_rcvd >= amt_byte_transfer_count)
+            // Full duplex: stream back for as long as the tester is sending.
+            if ((p_evt->params.hvx.flags & AMT_NOTIF_FLAG_DUPLEX) && !p_amt_c->writing)
+            {
+                err_code = nrf_ble_amtc_write_spam_start(p_amt_c, 0);
+                if (err_code != NRF_SUCCESS)
+                {
+                    NRF_LOG_ERROR("nrf_ble_amtc_write_spam_start() returned 0x%x.\r\n", err_code);
+                }
+            }
+
+            if ((p_evt->params.hvx.flags & AMT_NOTIF_FLAG_LAST) && p_amt_c->writing)
+            {
+                nrf_ble_amtc_write_spam_stop(p_amt_c);
+
+                char bytes_str[21];
+                NRF_LOG_RAW_INFO("Sent %s bytes of Write Without Response.\r\n",
+                             nrf_log_push(uint64_to_str(p_amt_c->bytes_written, bytes_str)));
+            }
+
+            // Older testers do not set the LAST flag, fall back to the byte count unless the run is timed.
+            if (   !complete
+                && (   (p_evt->params.hvx.flags & AMT_NOTIF_FLAG_LAST)
+                    || (   !(p_evt->params.hvx.flags & AMT_NOTIF_FLAG_TIMED)
+                        && (p_evt->params.hvx.bytes_rcvd >= amt_byte_transfer_count))))
             {
+                nrf_ble_amtc_seq_stats_t const * p_seq = &p_amt_c->seq_stats;
+
                 bsp_board_led_off(LED_PROGRESS);
 
+                complete   = true;
                 bytes_cnt  = 0;
                 kbytes_cnt = 0;
 
-                NRF_LOG_RAW_INFO("AMT Transfer complete, received %u bytes.\r\n",
-                             p_evt->params.hvx.bytes_rcvd);
+                char bytes_str[21];
+                NRF_LOG_RAW_INFO("AMT Transfer complete, received %s bytes.\r\n",
+                             nrf_log_push(uint64_to_str(p_evt->params.hvx.bytes_rcvd, bytes_str)));
+                NRF_LOG_RAW_INFO("Goodput %s bytes.\r\n",
+                             nrf_log_push(uint64_to_str(p_seq->goodput_bytes, bytes_str)));
+                NRF_LOG_RAW_INFO("Gaps %u, %s bytes lost. Duplicates %u, reordered %u, corrupted %u.\r\n",
+                             p_seq->gap_cnt,
+                             nrf_log_push(uint64_to_str(p_seq->lost_bytes, bytes_str)),
+                             p_seq->dup_cnt,
+                             p_seq->reorder_cnt,
+                             p_seq->corrupt_cnt);
+
+                if (p_evt->params.hvx.flags & AMT_NOTIF_FLAG_PACED)
+                {
+                    arrival_stats_print(&p_amt_c->arrival_stats, p_evt->params.hvx.bytes_rcvd);
+                }
+
+                nrf_ble_amts_rbc_set(p_amts, p_evt->params.hvx.bytes_rcvd);
+            }
+
+        } break;
+
+        case NRF_BLE_AMT_C_EVT_WRITE_REQ:
+        {
+            if (m_board_role == BOARD_RELAY)
+            {
+                NRF_LOG_RAW_INFO("Write transfers are not relayed.\r\n");
+                break;
+            }
+
+            NRF_LOG_RAW_INFO("Peer requested %u bytes of Write Without Response.\r\n",
+                             p_evt->params.write_req_len);
 
-                nrf_ble_amts_rbc_set(&m_amts, p_evt->params.hvx.bytes_rcvd);
+            err_code = nrf_ble_amtc_write_spam_start(p_amt_c, p_evt->params.write_req_len);
+            if (err_code != NRF_SUCCESS)
+            {
+                NRF_LOG_ERROR("nrf_ble_amtc_write_spam_start() returned 0x%x.\r\n", err_code);
             }
+        } break;
 
+        case NRF_BLE_AMT_C_EVT_WRITE_COMPLETE:
+        {
+            char bytes_str[21];
+            NRF_LOG_RAW_INFO("Write Without Response transfer complete, sent %s bytes.\r\n",
+                         nrf_log_push(uint64_to_str(p_evt->params.bytes_written, bytes_str)));
         } break;
 
         case NRF_BLE_AMT_C_EVT_RBC_READ_RSP:
-            NRF_LOG_RAW_INFO("AMT peer received %u bytes (%u KBytes).\r\n",
-                         (p_evt->params.rcv_bytes_cnt), (p_evt->params.rcv_bytes_cnt / 1024));
+        {
+            char bytes_str[21];
+            NRF_LOG_RAW_INFO("AMT peer received %s bytes (%u KBytes).\r\n",
+                         nrf_log_push(uint64_to_str(p_evt->params.rcv_bytes_cnt, bytes_str)),
+                         (uint32_t)(p_evt->params.rcv_bytes_cnt / 1024));
 
             terminate_test();
-            break;
+        } break;
 
         default:
             break;
@@ -478,6 +2003,66 @@ uint32_t phy_str(uint8_t phy)
 	return (uint32_t)phy_unkown;
 }
 
+uint32_t transfer_mode_str(uint8_t mode)
+{
+    static char const * mode_str[] =
+    {
+        "Notifications",
+        "Write w/o rsp",
+        "Full duplex",
+        "Indications",
+    };
+
+	static char const mode_unkown[] = "Unkown";
+
+	if (mode < ARRAY_SIZE(mode_str))
+	{
+		return (uint32_t)(mode_str[mode]);
+	}
+	return (uint32_t)mode_unkown;
+}
+
+uint32_t sweep_axes_str(uint8_t axes)
+{
+    static char const * axes_str[] =
+    {
+        "PHY x interval",
+        "PHY x MTU",
+        "Interval x MTU",
+        "PHY x interval x MTU",
+        "Ext. x TX power",
+        "All",
+    };
+
+	static char const axes_unkown[] = "Unkown";
+
+	if (axes < ARRAY_SIZE(axes_str))
+	{
+		return (uint32_t)(axes_str[axes]);
+	}
+	return (uint32_t)axes_unkown;
+}
+
+uint32_t payload_str(uint8_t payload)
+{
+    static char const * payload_str[] =
+    {
+        "None",
+        "Incrementing",
+        "PRBS9",
+        "PRBS15",
+        "0xA5 + CRC32",
+    };
+
+	static char const payload_unkown[] = "Unkown";
+
+	if (payload < ARRAY_SIZE(payload_str))
+	{
+		return (uint32_t)(payload_str[payload]);
+	}
+	return (uint32_t)payload_unkown;
+}
+
 /**
  * @brief Parses advertisement data, providing length and location of the field in case
  *        matching data is found.
@@ -569,20 +2154,27 @@ static bool find_adv_name(const ble_gap_evt_adv_report_t * p_adv_report, char co
  */
 void on_ble_gap_evt_connected(ble_gap_evt_t const * p_gap_evt)
 {
-    m_conn_handle = p_gap_evt->conn_handle;
-    m_gap_role    = p_gap_evt->params.connected.role;
+	setup_milestone_set(SETUP_CONNECTED);
+
+    link_ctx_t * p_link = link_alloc(p_gap_evt->conn_handle, p_gap_evt->params.connected.role);
+    if (p_link == NULL)
+    {
+        NRF_LOG_ERROR("No link for connection 0x%x.\r\n", p_gap_evt->conn_handle);
+        (void) sd_ble_gap_disconnect(p_gap_evt->conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+        return;
+    }
 
-    if (m_gap_role == BLE_GAP_ROLE_PERIPH)
+    if (p_link->role == BLE_GAP_ROLE_PERIPH)
     {
         NRF_LOG_RAW_INFO("Connected as a peripheral.\r\n");
 		display_print_line_inc("Connected as a peripheral.");
-		m_display_show = true;
+		app_evt_put(APP_EVT_DISPLAY_SHOW, 0);
     }
-    else if (m_gap_role == BLE_GAP_ROLE_CENTRAL)
+    else if (p_link->role == BLE_GAP_ROLE_CENTRAL)
     {
         NRF_LOG_RAW_INFO("Connected as a central.\r\n");
 		display_print_line_inc("Connected as a central.");
-		m_display_show = true;
+		app_evt_put(APP_EVT_DISPLAY_SHOW, 0);
     }
 
     // Stop scanning and advertising.
@@ -592,30 +2184,37 @@ void on_ble_gap_evt_connected(ble_gap_evt_t const * p_gap_evt)
     NRF_LOG_RAW_INFO("Discovering GATT database...\r\n");
 
     // Zero the database before starting discovery.
-    memset(&m_ble_db_discovery, 0x00, sizeof(m_ble_db_discovery));
+    memset(&p_link->db_discovery, 0x00, sizeof(p_link->db_discovery));
 
     ret_code_t err_code;
-    err_code  = ble_db_discovery_start(&m_ble_db_discovery, p_gap_evt->conn_handle);
+    err_code  = ble_db_discovery_start(&p_link->db_discovery, p_gap_evt->conn_handle);
     APP_ERROR_CHECK(err_code);
 
 	
-	if(m_board_role == BOARD_TESTER)
+	if(p_link->role == BLE_GAP_ROLE_CENTRAL)
 	{
-		test_params_t test_params;
-		get_test_params(&test_params);
-		
 		// Request PHY.
 		ble_gap_phys_t phys =
 		{
-			.tx_phys = test_params.rxtx_phy,
-			.rx_phys = test_params.rxtx_phy,
+			.tx_phys = m_applied_params.rxtx_phy,
+			.rx_phys = m_applied_params.rxtx_phy,
 		};
 
 		err_code = sd_ble_gap_phy_request(p_gap_evt->conn_handle, &phys);
 		APP_ERROR_CHECK(err_code);
 		
-		err_code = sd_ble_gap_rssi_start(m_conn_handle, BLE_GAP_RSSI_THRESHOLD_INVALID, 0);
+		err_code = sd_ble_gap_rssi_start(p_gap_evt->conn_handle, BLE_GAP_RSSI_THRESHOLD_INVALID, 0);
 		APP_ERROR_CHECK(err_code);
+		
+		// Keep scanning until all dummies are connected.
+		uint32_t link_target = link_target_get();
+		if((m_board_role == BOARD_TESTER) && (links_connected_cnt() < link_target))
+		{
+			NRF_LOG_RAW_INFO("Scanning for dummy %u of %u.\r\n", links_connected_cnt() + 1, link_target);
+			
+			err_code = sd_ble_gap_scan_start(&m_scan_param);
+			APP_ERROR_CHECK(err_code);
+		}
 	}
 	
 	
@@ -630,7 +2229,12 @@ void on_ble_gap_evt_connected(ble_gap_evt_t const * p_gap_evt)
  */
 void on_ble_gap_evt_disconnected(ble_gap_evt_t const * p_gap_evt)
 {
-    m_conn_handle = BLE_CONN_HANDLE_INVALID;
+    link_ctx_t * p_link = link_get(p_gap_evt->conn_handle);
+    if (p_link != NULL)
+    {
+        p_link->state       = LINK_STATE_FREE;
+        p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
 
     NRF_LOG_RAW_INFO("Disconnected (reason 0x%x).\r\n", p_gap_evt->params.disconnected.reason);
 
@@ -658,10 +2262,12 @@ void on_ble_gap_evt_adv_report(ble_gap_evt_t const * p_gap_evt)
         return;
     }
 
+    setup_milestone_set(SETUP_ADV_REPORT);
+
     NRF_LOG_RAW_INFO("Device with matching name found");
 	
 	display_print_line_inc("Device with matching name found");
-	m_display_show = true;
+	app_evt_put(APP_EVT_DISPLAY_SHOW, 0);
 
     // Stop advertising.
     (void) sd_ble_gap_adv_stop();
@@ -724,7 +2330,7 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
         case BLE_GATTC_EVT_TIMEOUT:
         case BLE_GATTS_EVT_TIMEOUT:
             NRF_LOG_DEBUG("GATT timeout, disconnecting.\r\n");
-            err_code = sd_ble_gap_disconnect(m_conn_handle,
+            err_code = sd_ble_gap_disconnect(p_gap_evt->conn_handle,
                                              BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
             APP_ERROR_CHECK(err_code);
             break;
@@ -761,16 +2367,42 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
 					break;
 			}
 			
-			m_display_show = true;
-            m_phy_updated = true;
+			app_evt_put(APP_EVT_DISPLAY_SHOW, 0);
+			
+			link_ctx_t * p_link = link_get(p_gap_evt->conn_handle);
+			if(p_link != NULL)
+			{
+				link_setup_step_done(p_link, LINK_SETUP_PHY_UPDATED);
+			}
+			setup_milestone_set(SETUP_PHY_UPDATED);
         } break;
+
+		case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+			setup_milestone_set(SETUP_CONN_PARAM_UPDATED);
+			break;
 		
 		case BLE_EVT_TX_COMPLETE:
-			if(!m_counter_started)
+			if(m_board_role == BOARD_RELAY)
+			{
+				link_ctx_t * p_link = link_get(p_ble_evt->evt.common_evt.conn_handle);
+				if((p_link != NULL) && (p_link->role == BLE_GAP_ROLE_CENTRAL))
+				{
+					relay_tx_complete(p_ble_evt->evt.common_evt.params.tx_complete.count);
+				}
+				break;
+			}
+			
+			if(!m_counter_started && (m_transfer_mode != TRANSFER_MODE_WRITE))
 			{
+				setup_milestone_set(SETUP_FIRST_TX_COMPLETE);
 				NRF_LOG_RAW_INFO("Counter started\r\n");
 				counter_start();
 				m_counter_started = true;
+				
+				for(uint32_t i = 0; i < LINK_CNT; i++)
+				{
+					m_links[i].duplex_rcvd_start = m_links[i].amts.bytes_rcvd;
+				}
 			}
 			break;
 			
@@ -781,21 +2413,207 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
 }
 
 
-/**@brief Function for dispatching a BLE stack event to all modules with a BLE stack event handler.
+/**@brief Function for handling the BLE stack events of the GATT module.
+ */
+static void gatt_on_ble_evt(ble_evt_t * p_ble_evt, link_ctx_t * p_link)
+{
+    nrf_ble_gatt_on_ble_evt(&m_gatt, p_ble_evt);
+}
+
+
+/**@brief Function for handling the BLE stack events of the Connection Parameters module.
+ */
+static void conn_params_on_ble_evt(ble_evt_t * p_ble_evt, link_ctx_t * p_link)
+{
+    ble_conn_params_on_ble_evt(p_ble_evt);
+}
+
+
+/**@brief Function for handling the BLE stack events of the DB discovery module of a link.
+ */
+static void db_discovery_on_ble_evt(ble_evt_t * p_ble_evt, link_ctx_t * p_link)
+{
+    ble_db_discovery_on_ble_evt(&p_link->db_discovery, p_ble_evt);
+}
+
+
+/**@brief Function for handling the BLE stack events of the AMT server of a link.
+ */
+static void amts_on_ble_evt(ble_evt_t * p_ble_evt, link_ctx_t * p_link)
+{
+    nrf_ble_amts_on_ble_evt(&p_link->amts, p_ble_evt);
+}
+
+
+/**@brief Function for handling the BLE stack events of the AMT client of a link.
+ */
+static void amtc_on_ble_evt(ble_evt_t * p_ble_evt, link_ctx_t * p_link)
+{
+    nrf_ble_amtc_on_ble_evt(&p_link->amtc, p_ble_evt);
+}
+
+
+/**@brief Function for the handling of BLE stack events by the application.
+ */
+static void app_on_ble_evt(ble_evt_t * p_ble_evt, link_ctx_t * p_link)
+{
+    on_ble_evt(p_ble_evt);
+}
+
+
+/**@brief Function for subscribing a handler to BLE stack events.
+ *
+ * @details Handlers are called in the order they first subscribed. A handler subscribed again
+ *          keeps its place and gets the new IDs as well. A handler of a link is only called for
+ *          the events of a connection with a link, and gets that link.
+ *
+ * @param[in] handler     Event handler.
+ * @param[in] per_link    Whether the handler needs the link of the event.
+ * @param[in] p_evt_ids   IDs of the events to pass to the handler, NULL for all events.
+ * @param[in] evt_id_cnt  Number of IDs.
+ */
+static void ble_evt_subscribe(ble_evt_handler_t handler, bool per_link,
+                              uint16_t const * p_evt_ids, uint32_t evt_id_cnt)
+{
+    uint32_t index = 0;
+
+    while ((index < m_ble_evt_handler_cnt) && (m_ble_evt_handlers[index].handler != handler))
+    {
+        index++;
+    }
+
+    if (index == m_ble_evt_handler_cnt)
+    {
+        APP_ERROR_CHECK_BOOL(m_ble_evt_handler_cnt < BLE_EVT_HANDLER_MAX);
+        m_ble_evt_handler_cnt++;
+    }
+
+    m_ble_evt_handlers[index].handler  = handler;
+    m_ble_evt_handlers[index].per_link = per_link;
+
+    if (p_evt_ids == NULL)
+    {
+        for (uint32_t i = 0; i < BLE_EVT_ID_CNT; i++)
+        {
+            m_ble_evt_subscribers[i] |= (1 << index);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < evt_id_cnt; i++)
+    {
+        APP_ERROR_CHECK_BOOL(p_evt_ids[i] < BLE_EVT_ID_CNT);
+        m_ble_evt_subscribers[p_evt_ids[i]] |= (1 << index);
+    }
+}
+
+
+/**@brief Function for subscribing the application and the modules to the BLE stack events they handle.
+ *
+ * @details The application comes first, it allocates the link of a new connection.
+ *
+ *          The lists hold the event IDs of the switch statements of the handlers. Two modules
+ *          also retry, after their switch, a request that found the SoftDevice busy:
+ *          - nrf_ble_gatt_on_ble_evt() retries an ATT MTU exchange that failed with NRF_ERROR_BUSY.
+ *          - nrf_ble_amtc_on_ble_evt() calls tx_buffer_process(), which retries a CCCD write or a
+ *            Received Bytes Count read.
+ *          Both are busy while another GATT client procedure runs, and that procedure ends with a
+ *          GATT client response event. These modules get the response events of the procedures
+ *          in flight on a link (gattc_rsp_evts) on top of their own, so neither is called for
+ *          GATTS_EVT_WRITE, and only the AMT client gets HVX. A module added here must be checked
+ *          for such work too.
+ */
+static void ble_evt_handlers_init(void)
+{
+    static uint16_t const app_evts[] =
+    {
+        BLE_GAP_EVT_ADV_REPORT, BLE_GAP_EVT_CONNECTED, BLE_GAP_EVT_DISCONNECTED,
+        BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST, BLE_GAP_EVT_CONN_PARAM_UPDATE, BLE_GAP_EVT_PHY_UPDATE,
+        BLE_GATTS_EVT_SYS_ATTR_MISSING, BLE_GATTC_EVT_TIMEOUT, BLE_GATTS_EVT_TIMEOUT,
+        BLE_EVT_USER_MEM_REQUEST, BLE_EVT_TX_COMPLETE,
+    };
+    static uint16_t const conn_params_evts[] =
+    {
+        BLE_GAP_EVT_CONNECTED, BLE_GAP_EVT_DISCONNECTED, BLE_GAP_EVT_CONN_PARAM_UPDATE, BLE_GATTS_EVT_WRITE,
+    };
+    static uint16_t const gatt_evts[] =
+    {
+        BLE_GAP_EVT_CONNECTED, BLE_GAP_EVT_DISCONNECTED, BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST,
+    };
+    static uint16_t const db_discovery_evts[] =
+    {
+        BLE_GAP_EVT_DISCONNECTED,
+        BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP, BLE_GATTC_EVT_CHAR_DISC_RSP, BLE_GATTC_EVT_DESC_DISC_RSP,
+    };
+    static uint16_t const amts_evts[] =
+    {
+        BLE_GAP_EVT_CONNECTED, BLE_GAP_EVT_DISCONNECTED,
+        BLE_GATTS_EVT_WRITE, BLE_GATTS_EVT_HVC, BLE_EVT_TX_COMPLETE,
+    };
+    static uint16_t const amtc_evts[] =
+    {
+        BLE_GAP_EVT_DISCONNECTED, BLE_GATTC_EVT_HVX, BLE_EVT_TX_COMPLETE,
+    };
+    static uint16_t const gattc_rsp_evts[] =
+    {
+        BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP, BLE_GATTC_EVT_CHAR_DISC_RSP, BLE_GATTC_EVT_DESC_DISC_RSP,
+        BLE_GATTC_EVT_READ_RSP, BLE_GATTC_EVT_WRITE_RSP, BLE_GATTC_EVT_EXCHANGE_MTU_RSP,
+        BLE_GATTC_EVT_TIMEOUT,
+    };
+
+    ble_evt_subscribe(app_on_ble_evt,          false, app_evts,          ARRAY_SIZE(app_evts));
+    ble_evt_subscribe(conn_params_on_ble_evt,  false, conn_params_evts,  ARRAY_SIZE(conn_params_evts));
+    ble_evt_subscribe(gatt_on_ble_evt,         false, gatt_evts,         ARRAY_SIZE(gatt_evts));
+    ble_evt_subscribe(gatt_on_ble_evt,         false, gattc_rsp_evts,    ARRAY_SIZE(gattc_rsp_evts));
+    ble_evt_subscribe(db_discovery_on_ble_evt, true,  db_discovery_evts, ARRAY_SIZE(db_discovery_evts));
+    ble_evt_subscribe(amts_on_ble_evt,         true,  amts_evts,         ARRAY_SIZE(amts_evts));
+    ble_evt_subscribe(amtc_on_ble_evt,         true,  amtc_evts,         ARRAY_SIZE(amtc_evts));
+    ble_evt_subscribe(amtc_on_ble_evt,         true,  gattc_rsp_evts,    ARRAY_SIZE(gattc_rsp_evts));
+}
+
+
+/**@brief Function for dispatching a BLE stack event to the handlers subscribed to it.
  *
  * @details This function is called from the BLE Stack event interrupt handler after a BLE stack
- *          event has been received.
+ *          event has been received. HVX only reaches the AMT client, and TX_COMPLETE the
+ *          application and the AMT server and client, where all six modules used to get both.
  *
  * @param[in] p_ble_evt  Bluetooth stack event.
  */
 static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
 {
-    on_ble_evt(p_ble_evt);
-    ble_conn_params_on_ble_evt(p_ble_evt);
-    ble_db_discovery_on_ble_evt(&m_ble_db_discovery, p_ble_evt);
-    nrf_ble_gatt_on_ble_evt(&m_gatt, p_ble_evt);
-    nrf_ble_amts_on_ble_evt(&m_amts, p_ble_evt);
-    nrf_ble_amtc_on_ble_evt(&m_amtc, p_ble_evt);
+    uint16_t evt_id = p_ble_evt->header.evt_id;
+
+    if (evt_id >= BLE_EVT_ID_CNT)
+    {
+        return;
+    }
+
+    // The connection handle is at the same place in all events. Look the link up before
+    // on_ble_evt() frees it on disconnection, and after it allocates one on connection.
+    uint16_t     conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    link_ctx_t * p_link      = link_get(conn_handle);
+    uint32_t     subscribers = m_ble_evt_subscribers[evt_id];
+
+    for (uint32_t i = 0; subscribers != 0; i++, subscribers >>= 1)
+    {
+        if (!(subscribers & 1))
+        {
+            continue;
+        }
+
+        if ((p_link == NULL) && (evt_id == BLE_GAP_EVT_CONNECTED))
+        {
+            p_link = link_get(conn_handle);
+        }
+
+        if (m_ble_evt_handlers[i].per_link && (p_link == NULL))
+        {
+            continue;
+        }
+
+        m_ble_evt_handlers[i].handler(p_ble_evt, p_link);
+    }
 }
 
 
@@ -825,6 +2643,7 @@ static void ble_stack_init(void)
     APP_ERROR_CHECK(err_code);
 
     // Register a BLE event handler with the SoftDevice handler library.
+    ble_evt_handlers_init();
     err_code = softdevice_ble_evt_handler_set(ble_evt_dispatch);
     APP_ERROR_CHECK(err_code);
 }
@@ -860,9 +2679,10 @@ void advertising_start(void)
     };
 
     NRF_LOG_RAW_INFO("Starting advertising.\r\n");
+	setup_milestone_set(SETUP_START);
 	
 	display_print_line_inc("Starting advertising.");
-	m_display_show = true;
+	app_evt_put(APP_EVT_DISPLAY_SHOW, 0);
 
     uint32_t err_code;
     err_code = sd_ble_gap_adv_start(&adv_params);
@@ -877,9 +2697,10 @@ void advertising_start(void)
 void scan_start(void)
 {
     NRF_LOG_RAW_INFO("Starting scan.\r\n");
+	setup_milestone_set(SETUP_START);
 	
 	display_print_line_inc("Starting scan.");
-	m_display_show = true;
+	app_evt_put(APP_EVT_DISPLAY_SHOW, 0);
 
     ret_code_t err_code;
     err_code = sd_ble_gap_scan_start(&m_scan_param);
@@ -897,12 +2718,23 @@ static void button_event_handler(uint8_t pin_no, uint8_t button_action)
 {
 	if(button_action == APP_BUTTON_PUSH)
 	{
+		// Stopping a test or a sweep is all a push does while they run.
+		bool consumed = m_sweep_active || m_test_started;
+		
+		if(m_sweep_active)
+		{
+			m_sweep_abort = true;
+		}
 		if(m_test_started)
 		{
-			counter_stop();
-			terminate_test();
+			// Disconnecting calls into the SoftDevice, leave it to the main loop.
+			app_evt_put(APP_EVT_TEST_STOP, 0);
+		}
+		
+		if(!consumed)
+		{
+			app_evt_put(APP_EVT_BUTTON, pin_no);
 		}
-		m_button = pin_no;
 	}
 }
 
@@ -923,24 +2755,7 @@ static void buttons_enable(void)
 {
     ret_code_t err_code;
     err_code = app_button_enable();
-    APP_ERROR_CHECK(err_code);
-}
-
-uint8_t button_read(void)
-{
-	m_button = 0xff;
-    //buttons_enable();
-
-    while (m_button == 0xff)
-    {
-        if (!NRF_LOG_PROCESS())
-        {
-            wait_for_event();
-        }
-    }
-
-    //buttons_disable();
-	return m_button;
+    APP_ERROR_CHECK(err_code);
 }
 
 static void wait_for_event(void)
@@ -956,7 +2771,14 @@ static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
 {
     if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_SUCCEEDED)
     {
-        m_conn_interval_configured = true;
+        // The module negotiates the connection parameters of the peripheral link.
+        for (uint32_t i = 0; i < LINK_CNT; i++)
+        {
+            if ((m_links[i].state != LINK_STATE_FREE) && (m_links[i].role == BLE_GAP_ROLE_PERIPH))
+            {
+                link_setup_step_done(&m_links[i], LINK_SETUP_CONN_PARAMS);
+            }
+        }
     }
 }
 
@@ -998,9 +2820,16 @@ void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t * p_evt)
 {
     NRF_LOG_RAW_INFO("ATT MTU exchange completed.\r\n");
 	display_print_line_inc("ATT MTU exchange completed.");
-	m_display_show = true;
-    m_mtu_exchanged = true;
-    nrf_ble_amts_on_gatt_evt(&m_amts, p_evt);
+	app_evt_put(APP_EVT_DISPLAY_SHOW, 0);
+	setup_milestone_set(SETUP_MTU_EXCHANGED);
+
+    link_ctx_t * p_link = link_get(p_evt->conn_handle);
+    if (p_link != NULL)
+    {
+        link_setup_step_done(p_link, LINK_SETUP_MTU_EXCHANGED);
+        nrf_ble_amts_on_gatt_evt(&p_link->amts, p_evt);
+        nrf_ble_amtc_on_gatt_evt(&p_link->amtc, p_evt);
+    }
 }
 
 
@@ -1022,7 +2851,11 @@ void gatt_init(void)
  */
 static void db_disc_handler(ble_db_discovery_evt_t * p_evt)
 {
-    nrf_ble_amtc_on_db_disc_evt(&m_amtc, p_evt);
+    link_ctx_t * p_link = link_get(p_evt->conn_handle);
+    if (p_link != NULL)
+    {
+        nrf_ble_amtc_on_db_disc_evt(&p_link->amtc, p_evt);
+    }
 }
 
 
@@ -1031,14 +2864,24 @@ void client_init(void)
     ret_code_t err_code = ble_db_discovery_init(db_disc_handler);
     APP_ERROR_CHECK(err_code);
 
-    err_code = nrf_ble_amtc_init(&m_amtc, amtc_evt_handler);
-    APP_ERROR_CHECK(err_code);
+    for (uint32_t i = 0; i < LINK_CNT; i++)
+    {
+        err_code = nrf_ble_amtc_init(&m_links[i].amtc, amtc_evt_handler);
+        APP_ERROR_CHECK(err_code);
+    }
 }
 
 
 void server_init(void)
 {
-    nrf_ble_amts_init(&m_amts, amts_evt_handler);
+    nrf_ble_amts_init(&m_links[0].amts, amts_evt_handler);
+
+    // All links share the one service, only the connection state differs.
+    for (uint32_t i = 0; i < LINK_CNT; i++)
+    {
+        m_links[i].amts        = m_links[0].amts;
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
 }
 
 
@@ -1134,6 +2977,45 @@ void tx_power_set(int8_t tx_power)
 	APP_ERROR_CHECK(err_code);
 }
 
+/**@brief Function for restricting the data channels of the tester's connections.
+ *
+ * @details Keeps @p channel_cnt channels spread evenly over the band. Only the central can set the
+ *          channel map, the SoftDevice applies it to current and future connections.
+ *
+ * @param[in] channel_cnt   Number of data channels to use, 2 to 37, 0 for all.
+ */
+void channel_map_set(uint8_t channel_cnt)
+{
+	ret_code_t err_code;
+	ble_opt_t  opt;
+	
+	if(m_board_role != BOARD_TESTER)
+	{
+		return;
+	}
+	
+	if((channel_cnt == 0) || (channel_cnt > BLE_DATA_CHANNEL_CNT))
+	{
+		channel_cnt = BLE_DATA_CHANNEL_CNT;
+	}
+	
+	memset(&opt, 0x00, sizeof(opt));
+	opt.gap_opt.ch_map.conn_handle = m_links[0].conn_handle;
+	
+	for(uint32_t i = 0; i < channel_cnt; i++)
+	{
+		uint32_t channel = (i * BLE_DATA_CHANNEL_CNT) / channel_cnt;
+		
+		opt.gap_opt.ch_map.ch_map[channel / 8] |= (uint8_t)(1 << (channel % 8));
+	}
+	
+	err_code = sd_ble_opt_set(BLE_GAP_OPT_CH_MAP, &opt);
+	if(err_code != NRF_SUCCESS)
+	{
+		NRF_LOG_ERROR("Setting the channel map failed: 0x%x\r\n", err_code);
+	}
+}
+
 void set_all_parameters(test_params_t *params)
 {	
 	gatt_mtu_set(params->att_mtu);
@@ -1145,9 +3027,11 @@ void set_all_parameters(test_params_t *params)
     conn_evt_len_ext_set(params->conn_evt_len_ext_enabled);
     preferred_phy_set(params->rxtx_phy);
 	tx_power_set(params->tx_power);
+	channel_map_set(params->data_channels);
 	
-	amt_byte_transfer_count = params->transfer_data_size * 1024;
+	amt_byte_transfer_count = (uint64_t)params->transfer_data_size * 1024;
 	m_transfer_data.kb_transfer_size = params->transfer_data_size;
+	m_transfer_data.duration = params->duration;
 	
 	switch(params->rxtx_phy)
 	{
@@ -1173,6 +3057,8 @@ void set_all_parameters(test_params_t *params)
 			break;
 #endif
 	}
+	
+	m_applied_params = *params;
 }
 
 
@@ -1181,10 +3067,13 @@ void test_begin(bool continuous)
 	m_test_continuous = continuous;
 	
 	m_transfer_data.last_throughput = 0;
-	memset(&m_rssi_data, 0, sizeof(m_rssi_data));
-	m_rssi_data.max = -128;
-    m_rssi_data.range_multiplier_max = 500;
-    m_print_menu = false;
+	memset(&m_transfer_data.throughput_stats, 0, sizeof(m_transfer_data.throughput_stats));
+	
+	if(!m_sweep_active)
+	{
+		memset(m_setup_stats, 0, sizeof(m_setup_stats));
+	}
+    m_ui_state = UI_STATE_BUSY;
 	
     NRF_LOG_RAW_INFO("\r\n\r\n\r\nPreparing the test.\r\n");
     NRF_LOG_FLUSH();
@@ -1193,6 +3082,15 @@ void test_begin(bool continuous)
 
     if (m_board_role == BOARD_TESTER)
     {
+		test_params_t test_params;
+		get_test_params(&test_params);
+		
+		if(test_params.link_cnt > NRF_BLE_CENTRAL_LINK_COUNT)
+		{
+			NRF_LOG_RAW_INFO("%u dummies asked, the SoftDevice is configured for %u central links.\r\n",
+							 test_params.link_cnt, NRF_BLE_CENTRAL_LINK_COUNT);
+		}
+		
         scan_start();
     }
     if (m_board_role == BOARD_DUMMY)
@@ -1203,69 +3101,353 @@ void test_begin(bool continuous)
 
 static bool is_test_ready()
 {
-    if (   (m_board_role == BOARD_TESTER)
-        && m_conn_interval_configured
-        && m_notif_enabled
-        && m_mtu_exchanged
-        && m_phy_updated
-        && !m_run_test)
+    if ((m_board_role != BOARD_TESTER) || m_run_test)
+    {
+        return false;
+    }
+
+    // The events of the previous run come first, the trace dump needs the samples test_run() clears.
+    if (m_app_evt_in != m_app_evt_out)
     {
-        return true;
+        return false;
     }
-    return false;
+
+    // Links stay finished between the runs of a continuous test.
+    uint32_t ready_cnt = links_in_state_cnt(LINK_STATE_READY) + links_in_state_cnt(LINK_STATE_FINISHED);
+
+    return (ready_cnt >= link_target_get());
 }
 
-static void display_timer_handler(void *p_context)
+/**@brief Function for summing the TX_COMPLETE events and completed packets of all connected links.
+ */
+static void links_tx_cnt_get(uint32_t * p_evt_cnt, uint32_t * p_pkt_cnt)
 {
-	int8_t rssi;
-	uint32_t err_code;
-	
-	m_transfer_data.counter_ticks = counter_get();
-	m_transfer_data.bytes_transfered = m_amts.bytes_sent;
-	m_display_show_transfer_data = true;
+	*p_evt_cnt = 0;
+	*p_pkt_cnt = 0;
 	
-	err_code = sd_ble_gap_rssi_get(m_conn_handle, &rssi);
-	if(err_code == NRF_SUCCESS)
+	for(uint32_t i = 0; i < LINK_CNT; i++)
 	{
-		if(m_rssi_data.nr_of_samples == 0)
+		if(m_links[i].state != LINK_STATE_FREE)
 		{
-			m_rssi_data.moving_average = rssi;
+			*p_evt_cnt += m_links[i].amts.tx_stats.evt_cnt;
+			*p_pkt_cnt += m_links[i].amts.tx_stats.pkt_cnt;
 		}
-		else
+	}
+}
+
+/**@brief Function for adding a sample to the throughput trace of the current run.
+ */
+static void trace_sample_add(void)
+{
+	trace_sample_t * p_sample = &m_trace[m_trace_cnt % TRACE_SAMPLE_CNT];
+	trace_progress_t now;
+	uint32_t         pkt_cnt;
+	
+	now.ticks = counter_now() - m_trace_start_ticks;
+	now.bytes = m_transfer_data.bytes_transfered;
+	links_tx_cnt_get(&now.tx_complete_cnt, &pkt_cnt);
+	
+	// A display period is 200 ms, so the progress in it fits the narrow fields.
+	p_sample->ticks           = (uint32_t)(now.ticks - m_trace_progress.ticks);
+	p_sample->bytes           = (uint32_t)(now.bytes - m_trace_progress.bytes);
+	p_sample->tx_complete_cnt = (uint16_t)(now.tx_complete_cnt - m_trace_progress.tx_complete_cnt);
+	p_sample->rssi            = link_display_get()->rssi.current_rssi;
+	
+	m_trace_progress = now;
+	m_trace_cnt++;
+}
+
+/**@brief Function for attributing the progress since the previous display timer period to an RSSI bin.
+ *
+ * @details The SoftDevice only reports a blended RSSI, not the channel it was measured on, so the
+ *          progress is binned by signal strength instead.
+ *
+ * @param[in] rssi   RSSI read at the end of the period, in dBm.
+ */
+static void rssi_bin_add(int8_t rssi)
+{
+	int32_t bin = (rssi - RSSI_BIN_MIN_DBM) / RSSI_BIN_DB;
+	
+	if(bin < 0)
+	{
+		bin = 0;
+	}
+	else if(bin >= RSSI_BIN_CNT)
+	{
+		bin = RSSI_BIN_CNT - 1;
+	}
+	
+	rssi_bin_t * p_bin = &m_rssi_bins[bin];
+	uint64_t bytes = m_trace_progress.bytes - m_rssi_bin_prev.bytes;
+	
+	p_bin->periods++;
+	p_bin->stalls          += (bytes == 0) ? 1 : 0;
+	p_bin->ticks           += m_trace_progress.ticks - m_rssi_bin_prev.ticks;
+	p_bin->bytes           += bytes;
+	p_bin->tx_complete_cnt += m_trace_progress.tx_complete_cnt - m_rssi_bin_prev.tx_complete_cnt;
+	uint32_t evt_cnt;
+	uint32_t pkt_cnt;
+	
+	links_tx_cnt_get(&evt_cnt, &pkt_cnt);
+	
+	p_bin->pkt_cnt         += pkt_cnt - m_rssi_bin_prev_pkt_cnt;
+	
+	m_rssi_bin_prev         = m_trace_progress;
+	m_rssi_bin_prev_pkt_cnt = pkt_cnt;
+}
+
+static void pace_timer_handler(void *p_context)
+{
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		if(m_links[i].state == LINK_STATE_RUNNING)
 		{
-			m_rssi_data.moving_average = 
-					(float)m_rssi_data.moving_average * RSSI_MOVING_AVERAGE_ALPHA
-					+ (float)rssi * (1.0f - RSSI_MOVING_AVERAGE_ALPHA);
+			nrf_ble_amts_pace_refill(&m_links[i].amts);
 		}
+	}
+}
+
+/**@brief Function for reading the RSSI of a link and updating its average and link budget.
+ *
+ * @param[in] margin   Link budget minus TX power of the applied parameters, see rssi_link_budget_get().
+ *
+ * @return   true if the RSSI could be read.
+ */
+static bool link_rssi_update(link_ctx_t * p_link, int32_t margin)
+{
+	rssi_data_t * p_rssi = &p_link->rssi;
+	int8_t rssi;
+	
+	if(sd_ble_gap_rssi_get(p_link->conn_handle, &rssi) != NRF_SUCCESS)
+	{
+		return false;
+	}
+	
+	if(p_rssi->nr_of_samples == 0)
+	{
+		p_rssi->moving_average = (int32_t)rssi << RSSI_Q_BITS;
+	}
+	else
+	{
+		p_rssi->moving_average = rssi_average_update(p_rssi->moving_average, rssi);
+	}
+	
+	p_rssi->sum += rssi;
+	p_rssi->nr_of_samples++;
+	p_rssi->current_rssi = rssi;
+	
+	//zero in case the RSSI value magically drops below the spec
+	p_rssi->link_budget = rssi_link_budget_get(margin, p_rssi->moving_average);
+	
+	if(p_rssi->link_budget > p_rssi->link_budget_max)
+    {
+        p_rssi->link_budget_max = p_rssi->link_budget;
+    }
+	
+    p_rssi->range_multiplier = rssi_range_multiplier_get(p_rssi->link_budget);
+	
+	return true;
+}
+
+static void display_timer_handler(void *p_context)
+{
+	link_ctx_t * p_display_link = link_display_get();
+	bool         rssi_read      = false;
+	int32_t      rssi_margin    = ((int32_t)m_applied_params.link_budget - m_applied_params.tx_power) << RSSI_Q_BITS;
+	
+	m_transfer_data.counter_ticks = counter_get();
+	m_transfer_data.bytes_transfered = 0;
+	for(uint32_t i = 0; i < LINK_CNT; i++)
+	{
+		link_ctx_t * p_link = &m_links[i];
 		
-		m_rssi_data.sum += rssi;
-		m_rssi_data.nr_of_samples++;
-		m_rssi_data.current_rssi = rssi;
-		
-		test_params_t test_params;
-		get_test_params(&test_params);
+		if(p_link->state == LINK_STATE_RUNNING)
+		{
+			p_link->transfer.counter_ticks    = m_transfer_data.counter_ticks;
+			p_link->transfer.bytes_transfered = (m_transfer_mode == TRANSFER_MODE_WRITE) ? p_link->amts.write_rcvd : p_link->amts.bytes_sent;
+		}
 		
-		//check in case the RSSI value magically drops below the spec
-		if( (-m_rssi_data.moving_average) > (test_params.link_budget - test_params.tx_power))
+		if((p_link->state == LINK_STATE_RUNNING) || (p_link->state == LINK_STATE_FINISHED))
 		{
-			m_rssi_data.link_budget = 0;
+			m_transfer_data.bytes_transfered += p_link->transfer.bytes_transfered;
 		}
-		else
+		
+		if(p_link->state != LINK_STATE_FREE)
 		{
-			m_rssi_data.link_budget = test_params.link_budget - test_params.tx_power + m_rssi_data.moving_average;
+			bool read = link_rssi_update(p_link, rssi_margin);
+			
+			rssi_read = rssi_read || (read && (p_link == p_display_link));
 		}
+	}
+	app_evt_put(APP_EVT_DISPLAY_TRANSFER, 0);
+	
+	// The trace and link quality bins follow the link on the display.
+	trace_sample_add();
+	
+	if(rssi_read)
+	{
+		rssi_bin_add(m_trace[(m_trace_cnt - 1) % TRACE_SAMPLE_CNT].rssi);
+	}
+}
+
+/**@brief Function for setting the role of the board from the first button pushed.
+ */
+static void board_role_select(uint8_t button)
+{
+	test_params_t test_params;
+	get_test_params(&test_params);
+	
+	if(button == BUTTON_1)
+	{
+		m_board_role = BOARD_TESTER;
+		preferred_phy_set(test_params.rxtx_phy);
+		channel_map_set(test_params.data_channels);
+		m_ui_state = UI_STATE_MENU;
+		menu_print();
+	}
+	else if(button == BUTTON_3)
+	{
+		// Finds the dummy first and only advertises to the tester once it is attached.
+		m_board_role = BOARD_RELAY;
+#if defined(S140)
+		preferred_phy_set(BLE_GAP_PHY_2MBPS | BLE_GAP_PHY_1MBPS | BLE_GAP_PHY_CODED);
+#elif defined(S132)
+		preferred_phy_set(BLE_GAP_PHY_2MBPS | BLE_GAP_PHY_1MBPS);
+#endif
+		scan_start();
+	}
+	else
+	{
+		m_board_role = BOARD_DUMMY;
+#if defined(S140)
+		preferred_phy_set(BLE_GAP_PHY_2MBPS | BLE_GAP_PHY_1MBPS | BLE_GAP_PHY_CODED);
+#elif defined(S132)
+		preferred_phy_set(BLE_GAP_PHY_2MBPS | BLE_GAP_PHY_1MBPS);
+#endif
+		advertising_start();
+	}
+	
+	// Buttons are not used from now on, unless to stop the tests of the tester.
+	if(m_board_role != BOARD_TESTER)
+	{
+		m_ui_state = UI_STATE_BUSY;
+	}
+}
+
+/**@brief Function for handling a button pushed, according to what the user interface waits for.
+ */
+static void ui_button_handle(uint8_t button)
+{
+	switch(m_ui_state)
+	{
+		case UI_STATE_ROLE_SELECT:
+			board_role_select(button);
+			break;
 		
-		if(m_rssi_data.link_budget > m_rssi_data.link_budget_max)
-        {
-            m_rssi_data.link_budget_max = m_rssi_data.link_budget;
-        }
-        
-		if(m_rssi_data.link_budget > m_rssi_data.link_budget_max)
-        {
-            m_rssi_data.link_budget_max = m_rssi_data.link_budget;
-        }
+		case UI_STATE_MENU:
+			menu_button_handle(button);
+			
+			// Not redrawn when the selection started a test.
+			if(m_ui_state == UI_STATE_MENU)
+			{
+				menu_print();
+			}
+			break;
+		
+		case UI_STATE_TEST_READY:
+			m_ui_state = UI_STATE_BUSY;
+			test_run(false);
+			break;
+		
+		case UI_STATE_TEST_DONE:
+			if(m_menu_pending)
+			{
+				m_menu_pending = false;
+				m_ui_state = UI_STATE_MENU;
+				menu_print();
+			}
+			else
+			{
+				// The menu is shown once the links are down.
+				m_ui_state = UI_STATE_BUSY;
+			}
+			break;
+		
+		case UI_STATE_SWEEP_DONE:
+			m_ui_state = UI_STATE_MENU;
+			menu_print();
+			break;
+		
+		default:
+			break;
+	}
+}
+
+/**@brief Function for handling an event taken out of the queue by the main loop.
+ */
+static void app_evt_dispatch(app_evt_t const * p_evt)
+{
+	switch(p_evt->type)
+	{
+		case APP_EVT_BUTTON:
+			ui_button_handle(p_evt->param);
+			break;
+		
+		case APP_EVT_DISPLAY_SHOW:
+			display_show();
+			break;
+		
+		case APP_EVT_DISPLAY_TRANSFER:
+			display_draw_test_run_screen(&m_transfer_data, &link_display_get()->rssi);
+			break;
+		
+		case APP_EVT_TRANSFER_DONE:
+			display_test_done_screen(&m_transfer_data, &link_display_get()->rssi);
+			m_ui_state     = UI_STATE_TEST_DONE;
+			m_menu_pending = false;
+			break;
+		
+		case APP_EVT_MENU:
+			// Keep the results on screen until a button is pushed.
+			if(m_ui_state == UI_STATE_TEST_DONE)
+			{
+				m_menu_pending = true;
+			}
+			else
+			{
+				m_ui_state = UI_STATE_MENU;
+				menu_print();
+			}
+			break;
+		
+		case APP_EVT_SWEEP_NEXT:
+			sweep_next_point();
+			break;
+		
+		case APP_EVT_TRACE_PRINT:
+			trace_print();
+			rssi_bins_print();
+			break;
+		
+		case APP_EVT_TEST_STOP:
+			// The test may have ended on its own since the push.
+			if(!m_test_started)
+			{
+				break;
+			}
+			
+			counter_stop();
+			terminate_test();
+			
+			// Show the statistics of the transfers completed so far.
+			if(m_test_continuous && (m_transfer_data.throughput_stats.cnt != 0))
+			{
+				app_evt_put(APP_EVT_TRANSFER_DONE, 0);
+			}
+			break;
 		
-        m_rssi_data.range_multiplier = pow(10.0, (double)m_rssi_data.link_budget/20.0);
+		default:
+			break;
 	}
 }
 
@@ -1283,6 +3465,9 @@ int main(void)
 	err_code = app_timer_create(&m_display_timer_id, APP_TIMER_MODE_REPEATED, display_timer_handler);
 	APP_ERROR_CHECK(err_code);
 	
+	err_code = app_timer_create(&m_pace_timer_id, APP_TIMER_MODE_REPEATED, pace_timer_handler);
+	APP_ERROR_CHECK(err_code);
+	
 	buttons_init(buttons);
 	buttons_enable();
 	
@@ -1300,6 +3485,7 @@ int main(void)
 
 	test_params_t test_params;
 	get_test_params(&test_params);
+	m_applied_params = test_params;
 
     gatt_mtu_set(test_params.att_mtu);
     data_len_ext_set(&test_params);
@@ -1313,64 +3499,29 @@ int main(void)
     NRF_LOG_RAW_INFO("Throughput demo started.\r\n");
     NRF_LOG_RAW_INFO("Press button 1 on the board connected to the PC.\r\n");
     NRF_LOG_RAW_INFO("Press button 2 on other board.\r\n");
+    NRF_LOG_RAW_INFO("Press button 3 on a third board to relay between them, after starting the dummy.\r\n");
     NRF_LOG_FLUSH();
 	
 	display_clear();
     display_print_line_inc("- Press button 1 on this board");
     display_print_line_inc("- Press button 2 on other board.");
+    display_print_line_inc("- Press button 3 to relay.");
 	display_show();
 
-    uint8_t button = button_read();
-
-	if(button == BUTTON_1)
-	{
-		m_board_role = BOARD_TESTER;
-		preferred_phy_set(test_params.rxtx_phy);
-		m_print_menu = true;
-	}
-	else
-	{
-		m_board_role = BOARD_DUMMY;
-#if defined(S140)
-		preferred_phy_set(BLE_GAP_PHY_2MBPS | BLE_GAP_PHY_1MBPS | BLE_GAP_PHY_CODED);
-#elif defined(S132)
-		preferred_phy_set(BLE_GAP_PHY_2MBPS | BLE_GAP_PHY_1MBPS);
-#endif
-		advertising_start();
-	}
-
     for (;;)
     {
-		if(m_transfer_done)
+		app_evt_t evt;
+		
+		while(app_evt_get(&evt))
 		{
-			display_test_done_screen(&m_transfer_data, &m_rssi_data);
-			
-			button_read();
-			m_transfer_done = false;
+			app_evt_dispatch(&evt);
 		}
-		
-        if (m_print_menu && !m_transfer_done)
-        {
-            menu_print();
-        }
 
         if (is_test_ready())
         {
             m_run_test = true;
             test_run(!m_test_continuous);
         }
-
-		if(m_display_show_transfer_data)
-		{
-			display_draw_test_run_screen(&m_transfer_data, &m_rssi_data);
-			m_display_show_transfer_data = false;
-		}
-		
-		if(m_display_show)
-		{
-			display_show();
-			m_display_show = false;
-		}
 		
         if (!NRF_LOG_PROCESS())
         {
@@ -15,7 +15,9 @@
 #include "display.h"
 #include "menu.h"
 #include "ble_gap.h"
+#include "amt.h"
 #include "nrf_log.h"
+#include "sdk_config.h"
 
 typedef enum
 {
@@ -26,6 +28,9 @@ typedef enum
 	FLOAT,
 	STRING,
 	PHY_T,
+	MODE_T,
+	PAYLOAD_T,
+	SWEEP_T,
 } type_t;
 
 typedef void (*handler_t)(uint32_t option_index);
@@ -59,6 +64,7 @@ static test_params_t m_test_params =
 	.ble_version			  	= "BLE 5 High Speed",
 	.transfer_data_size			= 1024,
 	.link_budget				= 100,
+	.link_cnt					= 1,
 };
 
 static const test_params_t ble_5_HS_version_params =
@@ -359,6 +365,203 @@ menu_page_t menu_tx_power_page =
 	.next_pages				= NULL,
 };
 
+//TRANSFER MODE
+
+#define TRANSFER_MODE_OPTIONS_SIZE 4
+
+uint8_t transfer_mode_options[TRANSFER_MODE_OPTIONS_SIZE] = {TRANSFER_MODE_NOTIF, TRANSFER_MODE_WRITE, TRANSFER_MODE_DUPLEX, TRANSFER_MODE_INDICATION};
+
+void menu_transfer_mode_func(uint32_t option_index)
+{
+	m_test_params.transfer_mode = transfer_mode_options[option_index];
+	
+	set_all_parameters(&m_test_params);
+}
+
+menu_page_t menu_transfer_mode_page = 
+{
+	.nr_of_options			= TRANSFER_MODE_OPTIONS_SIZE,
+	.prev 					= &menu_main_page,
+	.option_values			= transfer_mode_options,
+	.option_current_value	= &m_test_params.transfer_mode,
+	.option_type			= MODE_T,
+	.option_unit			= "",
+	.show_values			= false,
+	.index					= 0,
+	.callback				= menu_transfer_mode_func,
+	.next_pages				= NULL,
+};
+
+//PAYLOAD
+
+#define PAYLOAD_OPTIONS_SIZE 5
+
+uint8_t payload_options[PAYLOAD_OPTIONS_SIZE] = {AMT_PAYLOAD_NONE, AMT_PAYLOAD_INCREMENTING, AMT_PAYLOAD_PRBS9,
+                                                 AMT_PAYLOAD_PRBS15, AMT_PAYLOAD_FIXED_CRC32};
+
+void menu_payload_func(uint32_t option_index)
+{
+	m_test_params.payload_type = payload_options[option_index];
+	
+	set_all_parameters(&m_test_params);
+}
+
+menu_page_t menu_payload_page = 
+{
+	.nr_of_options			= PAYLOAD_OPTIONS_SIZE,
+	.prev 					= &menu_main_page,
+	.option_values			= payload_options,
+	.option_current_value	= &m_test_params.payload_type,
+	.option_type			= PAYLOAD_T,
+	.option_unit			= "",
+	.show_values			= false,
+	.index					= 0,
+	.callback				= menu_payload_func,
+	.next_pages				= NULL,
+};
+
+//PACED RATE
+
+#define PACE_OPTIONS_SIZE 6
+
+uint16_t pace_options[PACE_OPTIONS_SIZE] = {0, 16, 64, 256, 512, 1000};
+
+void menu_pace_func(uint32_t option_index)
+{
+	m_test_params.pace_kbps = pace_options[option_index];
+	
+	set_all_parameters(&m_test_params);
+}
+
+menu_page_t menu_pace_page = 
+{
+	.nr_of_options			= PACE_OPTIONS_SIZE,
+	.prev 					= &menu_main_page,
+	.option_values			= pace_options,
+	.option_current_value	= &m_test_params.pace_kbps,
+	.option_type			= UINT16_T,
+	.option_unit			= "kbps",
+	.show_values			= false,
+	.index					= 0,
+	.callback				= menu_pace_func,
+	.next_pages				= NULL,
+};
+
+//TEST DURATION
+
+#define DURATION_OPTIONS_SIZE 5
+
+uint16_t duration_options[DURATION_OPTIONS_SIZE] = {0, 5, 10, 30, 60};
+
+void menu_duration_func(uint32_t option_index)
+{
+	m_test_params.duration = duration_options[option_index];
+	
+	set_all_parameters(&m_test_params);
+}
+
+menu_page_t menu_duration_page = 
+{
+	.nr_of_options			= DURATION_OPTIONS_SIZE,
+	.prev 					= &menu_main_page,
+	.option_values			= duration_options,
+	.option_current_value	= &m_test_params.duration,
+	.option_type			= UINT16_T,
+	.option_unit			= "s",
+	.show_values			= false,
+	.index					= 0,
+	.callback				= menu_duration_func,
+	.next_pages				= NULL,
+};
+
+//DATA CHANNELS
+
+#define DATA_CHANNELS_OPTIONS_SIZE 5
+
+uint8_t data_channels_options[DATA_CHANNELS_OPTIONS_SIZE] = {0, 20, 10, 5, 2};
+
+void menu_data_channels_func(uint32_t option_index)
+{
+	m_test_params.data_channels = data_channels_options[option_index];
+	
+	set_all_parameters(&m_test_params);
+}
+
+menu_page_t menu_data_channels_page = 
+{
+	.nr_of_options			= DATA_CHANNELS_OPTIONS_SIZE,
+	.prev 					= &menu_main_page,
+	.option_values			= data_channels_options,
+	.option_current_value	= &m_test_params.data_channels,
+	.option_type			= UINT8_T,
+	.option_unit			= "",
+	.show_values			= false,
+	.index					= 0,
+	.callback				= menu_data_channels_func,
+	.next_pages				= NULL,
+};
+
+//LINKS
+
+//only as many dummies as the SoftDevice has central links
+#if NRF_BLE_CENTRAL_LINK_COUNT < 4
+#define LINK_CNT_OPTIONS_SIZE NRF_BLE_CENTRAL_LINK_COUNT
+#else
+#define LINK_CNT_OPTIONS_SIZE 4
+#endif
+
+uint8_t link_cnt_options[] = {1, 2, 3, 4};
+
+void menu_link_cnt_func(uint32_t option_index)
+{
+	m_test_params.link_cnt = link_cnt_options[option_index];
+	
+	set_all_parameters(&m_test_params);
+}
+
+menu_page_t menu_link_cnt_page = 
+{
+	.nr_of_options			= LINK_CNT_OPTIONS_SIZE,
+	.prev 					= &menu_main_page,
+	.option_values			= link_cnt_options,
+	.option_current_value	= &m_test_params.link_cnt,
+	.option_type			= UINT8_T,
+	.option_unit			= "",
+	.show_values			= false,
+	.index					= 0,
+	.callback				= menu_link_cnt_func,
+	.next_pages				= NULL,
+};
+
+//SWEEP AXES
+
+#define SWEEP_AXES_OPTIONS_SIZE 6
+
+uint8_t sweep_axes_options[SWEEP_AXES_OPTIONS_SIZE] = {SWEEP_AXES_PHY_CONN_INTERVAL, SWEEP_AXES_PHY_ATT_MTU,
+                                                       SWEEP_AXES_CONN_INTERVAL_ATT_MTU, SWEEP_AXES_PHY_CONN_INTERVAL_ATT_MTU,
+                                                       SWEEP_AXES_EXT_TX_POWER, SWEEP_AXES_ALL};
+
+void menu_sweep_axes_func(uint32_t option_index)
+{
+	m_test_params.sweep_axes = sweep_axes_options[option_index];
+	
+	set_all_parameters(&m_test_params);
+}
+
+menu_page_t menu_sweep_axes_page = 
+{
+	.nr_of_options			= SWEEP_AXES_OPTIONS_SIZE,
+	.prev 					= &menu_main_page,
+	.option_values			= sweep_axes_options,
+	.option_current_value	= &m_test_params.sweep_axes,
+	.option_type			= SWEEP_T,
+	.option_unit			= "",
+	.show_values			= false,
+	.index					= 0,
+	.callback				= menu_sweep_axes_func,
+	.next_pages				= NULL,
+};
+
 //TRANSFER DATA SIZE
 
 #define TRANSFER_DATA_SIZE_OPTIONS_SIZE 3
@@ -397,12 +600,14 @@ menu_page_t menu_link_budget_page =
 
 //MAIN PAGE
 
-#define MAIN_OPTIONS_SIZE 11
+#define MAIN_OPTIONS_SIZE 19
 
 char *main_options[MAIN_OPTIONS_SIZE] = 
 {
 	"Run single transfer",
 	"Run cont. transfer",
+	"Run parameter sweep",
+	"Sweep axes",
 	"BLE version",
 	"Preferred PHY",
 	"Conn. interval",
@@ -410,7 +615,13 @@ char *main_options[MAIN_OPTIONS_SIZE] =
 	"Data length ext",
 	"Conn evt ext",
 	"Tx power",
+	"Data channels (0=all)",
+	"Dummies",
+	"Transfer mode",
+	"Payload",
+	"Paced rate (0=max)",
 	"Transfer data size",
+	"Test duration (0=size)",
 	"Link budget",
 };
 
@@ -418,6 +629,8 @@ menu_page_t *main_next_pages[MAIN_OPTIONS_SIZE] =
 {
 	NULL,
 	NULL,
+	NULL,
+	&menu_sweep_axes_page,
 	&menu_ble_version_page,
 	&menu_phy_page,
 	&menu_conn_int_page,
@@ -425,7 +638,13 @@ menu_page_t *main_next_pages[MAIN_OPTIONS_SIZE] =
 	&menu_data_length_ext_page,
 	&menu_conn_evt_length_ext_page,
 	&menu_tx_power_page,
+	&menu_data_channels_page,
+	&menu_link_cnt_page,
+	&menu_transfer_mode_page,
+	&menu_payload_page,
+	&menu_pace_page,
 	&menu_transfer_data_size_page,
+	&menu_duration_page,
 	&menu_link_budget_page,
 };
 
@@ -439,6 +658,10 @@ void menu_main_func(uint32_t option_index)
 	{
 		test_begin(true);
 	}
+	else if(option_index == 2)
+	{
+		sweep_begin();
+	}
 }
 
 menu_page_t menu_main_page = 
@@ -503,6 +726,18 @@ void print_var(void *array, uint8_t index, type_t type, char *unit, uint32_t x_p
 			var_array_u8 = array;
 			sprintf(str, "%s", (char*)phy_str(var_array_u8[index]));
 			break;
+		case MODE_T:
+			var_array_u8 = array;
+			sprintf(str, "%s", (char*)transfer_mode_str(var_array_u8[index]));
+			break;
+		case PAYLOAD_T:
+			var_array_u8 = array;
+			sprintf(str, "%s", (char*)payload_str(var_array_u8[index]));
+			break;
+		case SWEEP_T:
+			var_array_u8 = array;
+			sprintf(str, "%s", (char*)sweep_axes_str(var_array_u8[index]));
+			break;
 	}
 	
 	if(terminal)
@@ -517,74 +752,54 @@ void print_var(void *array, uint8_t index, type_t type, char *unit, uint32_t x_p
 	
 }
 
-void menu_print()
+static menu_page_t *m_menu_current_page = &menu_main_page;
+static uint8_t m_menu_opt_index = 0;		//option under the cursor on the current page
+
+void menu_print(void)
 {
-	static menu_page_t *m_menu_current_page = &menu_main_page;
-	
 	static const uint16_t number_pos = 220;
 	static const uint16_t text_pos = 20;
 	static uint8_t max_lines = MAX_LINES - 2;
 
 	uint8_t max_index = m_menu_current_page->nr_of_options;
-	uint8_t opt_index = m_menu_current_page->index;
+	uint8_t opt_index = m_menu_opt_index;
 	int8_t line_index;	//first line displayed on the screen
 	uint8_t cursor_index;
 	
-	while(1)
+	//start scrolling if opt_index is larger than the max lines that can be displayed on the screen - 1
+	//(start scrolling when cursor is a t the line before the bottom line)
+	if(opt_index > (max_lines - 1))
 	{
-		//start scrolling if opt_index is larger than the max lines that can be displayed on the screen - 1
-		//(start scrolling when cursor is a t the line before the bottom line)
-		if(opt_index > (max_lines - 1))
-		{
-			line_index =  max_lines - 1 - opt_index;
-			cursor_index = max_lines - 1;	//place cursor at the line before the bottom line
-		}
-		else
-		{
-			line_index = 0;
-			cursor_index = opt_index;
-		}
-		
-		display_clear();
-		//clear terminal screen (works in putty, tera term and RTT viewer, does not work in termite)
-		NRF_LOG_RAW_INFO("\033[2J\033[;H");
+		line_index =  max_lines - 1 - opt_index;
+		cursor_index = max_lines - 1;	//place cursor at the line before the bottom line
+	}
+	else
+	{
+		line_index = 0;
+		cursor_index = opt_index;
+	}
+	
+	display_clear();
+	//clear terminal screen (works in putty, tera term and RTT viewer, does not work in termite)
+	NRF_LOG_RAW_INFO("\033[2J\033[;H");
 
-		//display how the buttons works at the bottom of the page
-		display_print_line("[Btn1: Up, Btn2: Sel, Btn3: Down, Btn4: Back]", 0, max_lines+1);
-		display_print_line("->", 0, cursor_index);
-		
-		NRF_LOG_RAW_INFO("\033[%d;0H", max_index+1);
-		NRF_LOG_RAW_INFO("[Btn1: UP, Btn2: SEL, Btn3: DOWN, Btn4: BACK]");
-		NRF_LOG_RAW_INFO("\033[%d;%dH", opt_index + 1, 0);
-		NRF_LOG_RAW_INFO("->");
-		
-		for(int8_t i = 0; i < max_index; i++)
+	//display how the buttons works at the bottom of the page
+	display_print_line("[Btn1: Up, Btn2: Sel, Btn3: Down, Btn4: Back]", 0, max_lines+1);
+	display_print_line("->", 0, cursor_index);
+	
+	NRF_LOG_RAW_INFO("\033[%d;0H", max_index+1);
+	NRF_LOG_RAW_INFO("[Btn1: UP, Btn2: SEL, Btn3: DOWN, Btn4: BACK]");
+	NRF_LOG_RAW_INFO("\033[%d;%dH", opt_index + 1, 0);
+	NRF_LOG_RAW_INFO("->");
+	
+	for(int8_t i = 0; i < max_index; i++)
+	{
+		if((i+line_index) <= max_lines)
 		{
-			if((i+line_index) <= max_lines)
-			{
-				//print to display
-				print_var(m_menu_current_page->option_values, i, m_menu_current_page->option_type, 
-						m_menu_current_page->option_unit, text_pos, i + line_index, false);
-			
-				if(m_menu_current_page->show_values)
-				{
-					if(m_menu_current_page->next_pages != NULL)
-					{
-						menu_page_t **next_pages = m_menu_current_page->next_pages;
-						menu_page_t *next_page = next_pages[i];
-						if(next_page != NULL)
-						{
-							print_var(next_page->option_current_value, 0, next_page->option_type, 
-										next_page->option_unit, number_pos, i + line_index, false);
-						}
-					}
-				}
-			}
-			
-			//print to terminal
+			//print to display
 			print_var(m_menu_current_page->option_values, i, m_menu_current_page->option_type, 
-						m_menu_current_page->option_unit, text_pos, i, true);
-			
+					m_menu_current_page->option_unit, text_pos, i + line_index, false);
+		
 			if(m_menu_current_page->show_values)
 			{
 				if(m_menu_current_page->next_pages != NULL)
@@ -594,83 +809,99 @@ void menu_print()
 					if(next_page != NULL)
 					{
 						print_var(next_page->option_current_value, 0, next_page->option_type, 
-									next_page->option_unit, number_pos, i, true);
+									next_page->option_unit, number_pos, i + line_index, false);
 					}
 				}
 			}
-			
 		}
 		
-		//Update the display
-		display_show();
+		//print to terminal
+		print_var(m_menu_current_page->option_values, i, m_menu_current_page->option_type, 
+					m_menu_current_page->option_unit, text_pos, i, true);
 		
-		//Wait for button press from the user
-		switch (button_read())
+		if(m_menu_current_page->show_values)
 		{
-			case BUTTON_DOWN:
-				if(opt_index < (max_index-1))
+			if(m_menu_current_page->next_pages != NULL)
+			{
+				menu_page_t **next_pages = m_menu_current_page->next_pages;
+				menu_page_t *next_page = next_pages[i];
+				if(next_page != NULL)
 				{
-					opt_index++;
-					if(cursor_index < max_lines)
-					{
-						cursor_index++;
-					}
+					print_var(next_page->option_current_value, 0, next_page->option_type, 
+								next_page->option_unit, number_pos, i, true);
 				}
-				break;
+			}
+		}
+		
+	}
+	
+	//Update the display
+	display_show();
+}
 
-			case BUTTON_UP:
-				if(opt_index != 0)
-				{
-					opt_index--;
-				}
-				
-				if(cursor_index != 0)
-				{
-					cursor_index--;
-				}
-				break;
+void menu_button_handle(uint8_t button)
+{
+	uint8_t max_index = m_menu_current_page->nr_of_options;
+	
+	switch (button)
+	{
+		case BUTTON_DOWN:
+			if(m_menu_opt_index < (max_index-1))
+			{
+				m_menu_opt_index++;
+			}
+			break;
+
+		case BUTTON_UP:
+			if(m_menu_opt_index != 0)
+			{
+				m_menu_opt_index--;
+			}
+			break;
+		
+		case BUTTON_SEL:
+		{
+			menu_page_t *current_page = m_menu_current_page;
 			
-			case BUTTON_SEL:
-				
-				//save the current index in the page
-				//so that we get to the same place if we visit this page later
-				m_menu_current_page->index = opt_index;
+			//save the current index in the page
+			//so that we get to the same place if we visit this page later
+			current_page->index = m_menu_opt_index;
+		
+			//execute the callback function if this is not NULL
+			if(current_page->callback != NULL)
+			{
+				current_page->callback(m_menu_opt_index);
+			}
 			
-				//execute the callback function if this is not NULL
-				if(m_menu_current_page->callback != NULL)
-				{
-					m_menu_current_page->callback(opt_index);
-				}
-				
-				//change current page to next page
-				//If the next page is NULL it means that it should go back to the previous page
-				if(m_menu_current_page->next_pages != NULL)
+			//change current page to next page
+			//If the next page is NULL it means that it should go back to the previous page
+			if(current_page->next_pages != NULL)
+			{
+				menu_page_t **next_pages = current_page->next_pages;
+				menu_page_t *next_page = next_pages[m_menu_opt_index];
+				if(next_page != NULL)
 				{
-					menu_page_t **next_pages = m_menu_current_page->next_pages;
-					menu_page_t *next_page = next_pages[opt_index];
-					if(next_page != NULL)
+					//Do not change page if next page does not have options
+					if(next_page->option_values != NULL)
 					{
-						//Do not change page if next page does not have options
-						if(next_page->option_values != NULL)
-						{
-							m_menu_current_page = next_page;
-						}
+						m_menu_current_page = next_page;
 					}
 				}
-				else if(m_menu_current_page->prev != NULL)
-				{
-					m_menu_current_page = m_menu_current_page->prev;
-				}
-				
-				return;
+			}
+			else if(current_page->prev != NULL)
+			{
+				m_menu_current_page = current_page->prev;
+			}
 			
-			case BUTTON_BACK:
-				if(m_menu_current_page->prev != NULL)
-				{
-					m_menu_current_page = m_menu_current_page->prev;
-					return;
-				}
-				break;
-		}
+			m_menu_opt_index = m_menu_current_page->index;
+		} break;
+		
+		case BUTTON_BACK:
+			if(m_menu_current_page->prev != NULL)
+			{
+				m_menu_current_page = m_menu_current_page->prev;
+				m_menu_opt_index = m_menu_current_page->index;
+			}
+			break;
 	}
 }
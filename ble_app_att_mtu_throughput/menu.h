@@ -22,11 +22,15 @@
 #define BUTTON_BACK				  BUTTON_4
 
 void test_begin(bool continuous);
+void sweep_begin(void);
 void set_all_parameters(test_params_t *params);
 uint32_t phy_str(uint8_t phy);
-uint8_t button_read(void);
+uint32_t transfer_mode_str(uint8_t mode);
+uint32_t payload_str(uint8_t payload);
+uint32_t sweep_axes_str(uint8_t axes);
 
 void get_test_params(test_params_t *params);
 void menu_print(void);
+void menu_button_handle(uint8_t button);
 
 #endif //MENU_H
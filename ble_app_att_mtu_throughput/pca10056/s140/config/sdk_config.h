@@ -26,12 +26,12 @@
 
 // <o> NRF_BLE_CENTRAL_LINK_COUNT - Number of central links 
 #ifndef NRF_BLE_CENTRAL_LINK_COUNT
-#define NRF_BLE_CENTRAL_LINK_COUNT 1
+#define NRF_BLE_CENTRAL_LINK_COUNT 4
 #endif
 
 // <o> NRF_BLE_CENTRAL_LINK_COUNT - Number of central links 
 #ifndef NRF_BLE_CENTRAL_LINK_COUNT
-#define NRF_BLE_CENTRAL_LINK_COUNT 1
+#define NRF_BLE_CENTRAL_LINK_COUNT 4
 #endif
 
 // <o> NRF_BLE_PERIPHERAL_LINK_COUNT - Number of peripheral links 
@@ -0,0 +1,92 @@
+/* Copyright (c) 2017 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+/**@cond To Make Doxygen skip documentation generation for this file.
+ * @{
+ */
+
+#ifndef RSSI_H__
+#define RSSI_H__
+
+#include <stdint.h>
+#include "nrf.h"
+
+#define RSSI_Q_BITS                 8       /**< Fractional bits of the RSSI moving average. */
+#define RSSI_ALPHA_Q_BITS           15      /**< Fractional bits of RSSI_MOVING_AVERAGE_ALPHA. */
+#define RSSI_MOVING_AVERAGE_ALPHA   29491   /**< 0.9, a higher value lowers the frequency of the filter. */
+
+
+/**@brief   Function for adding an RSSI sample to a moving average.
+ *
+ * @details Rounded to nearest. |average| < 2^15, so the products fit in 32 bits.
+ *
+ * @param[in] average   Moving average with RSSI_Q_BITS fractional bits, in dBm.
+ * @param[in] rssi      Sample in dBm.
+ *
+ * @return  The new moving average.
+ */
+__STATIC_INLINE int32_t rssi_average_update(int32_t average, int8_t rssi)
+{
+    return (average * RSSI_MOVING_AVERAGE_ALPHA
+            + ((int32_t)rssi << RSSI_Q_BITS) * ((1 << RSSI_ALPHA_Q_BITS) - RSSI_MOVING_AVERAGE_ALPHA)
+            + (1 << (RSSI_ALPHA_Q_BITS - 1))) >> RSSI_ALPHA_Q_BITS;
+}
+
+
+/**@brief   Function for getting the link budget left at an RSSI, truncated to whole dB.
+ *
+ * @param[in] margin    Link budget minus TX power with RSSI_Q_BITS fractional bits, in dB.
+ * @param[in] average   Moving average of the RSSI with RSSI_Q_BITS fractional bits, in dBm.
+ *
+ * @return  The link budget in dB, 0 if the RSSI is below the sensitivity.
+ */
+__STATIC_INLINE uint8_t rssi_link_budget_get(int32_t margin, int32_t average)
+{
+    if ((-average) > margin)
+    {
+        return 0;
+    }
+
+    return (uint8_t)((margin + average) >> RSSI_Q_BITS);
+}
+
+
+/**@brief   Function for converting a link budget to the range multiplier, 10^(link_budget/20),
+ *          rounded down.
+ *
+ * @details Every 20 dB is a factor 10, the remainder is looked up in Q16. Saturates at UINT32_MAX.
+ */
+__STATIC_INLINE uint32_t rssi_range_multiplier_get(uint8_t link_budget)
+{
+    static const uint32_t db_to_lin_q16[20] =
+    {
+        65536, 73533, 82505, 92572, 103868, 116541, 130762, 146717, 164619, 184706,
+        207243, 232531, 260904, 292739, 328458, 368536, 413504, 463959, 520571, 584090,
+    };
+
+    uint64_t value = db_to_lin_q16[link_budget % 20];
+
+    for (uint32_t i = 0; i < (link_budget / 20); i++)
+    {
+        value *= 10;
+        if (value > ((uint64_t)UINT32_MAX << 16))
+        {
+            return UINT32_MAX;
+        }
+    }
+
+    return (uint32_t)(value >> 16);
+}
+
+#endif // RSSI_H__
+/** @}
+ *  @endcond
+ */
@@ -0,0 +1,10 @@
+/* Host stand-in for the nRF5 SDK device header, for the host tests only. */
+#ifndef NRF_H
+#define NRF_H
+
+#include <stdint.h>
+
+#define __STATIC_INLINE static inline
+#define __CLZ(x)        ((uint8_t)(((x) == 0) ? 32 : __builtin_clz(x)))
+
+#endif // NRF_H
@@ -0,0 +1,56 @@
+/* Host stand-in for the RTC driver. The test that uses it defines the functions on a simulated RTC. */
+#ifndef NRF_DRV_RTC_H__
+#define NRF_DRV_RTC_H__
+
+#include "sdk_stubs.h"
+
+typedef struct
+{
+    uint32_t COUNTER;                       //!< 24-bit counter. */
+    uint32_t EVENTS_OVRFLW;                 //!< Set when COUNTER wraps, cleared by the interrupt. */
+    uint32_t CC[4];                         //!< Compare registers. */
+} NRF_RTC_Type;
+
+typedef enum
+{
+    NRF_RTC_EVENT_OVERFLOW,
+} nrf_rtc_event_t;
+
+typedef enum
+{
+    NRF_DRV_RTC_INT_COMPARE0,
+    NRF_DRV_RTC_INT_COMPARE1,
+    NRF_DRV_RTC_INT_COMPARE2,
+    NRF_DRV_RTC_INT_COMPARE3,
+    NRF_DRV_RTC_INT_TICK,
+    NRF_DRV_RTC_INT_OVERFLOW,
+} nrf_drv_rtc_int_type_t;
+
+typedef void (*nrf_drv_rtc_handler_t)(nrf_drv_rtc_int_type_t int_type);
+
+typedef struct
+{
+    NRF_RTC_Type * p_reg;
+} nrf_drv_rtc_t;
+
+typedef struct
+{
+    uint16_t prescaler;
+} nrf_drv_rtc_config_t;
+
+extern NRF_RTC_Type g_rtc2;                 /**< Simulated RTC2, defined by the test. */
+
+#define NRF_DRV_RTC_INSTANCE(id)        { .p_reg = &g_rtc2 }
+#define NRF_DRV_RTC_DEFAULT_CONFIG      { .prescaler = 0 }
+
+ret_code_t nrf_drv_rtc_init(nrf_drv_rtc_t const * p_instance, nrf_drv_rtc_config_t const * p_config,
+                            nrf_drv_rtc_handler_t handler);
+void       nrf_drv_rtc_enable(nrf_drv_rtc_t const * p_instance);
+void       nrf_drv_rtc_tick_disable(nrf_drv_rtc_t const * p_instance);
+void       nrf_drv_rtc_overflow_enable(nrf_drv_rtc_t const * p_instance, bool enable_irq);
+ret_code_t nrf_drv_rtc_cc_set(nrf_drv_rtc_t const * p_instance, uint32_t channel, uint32_t val, bool enable_irq);
+ret_code_t nrf_drv_rtc_cc_disable(nrf_drv_rtc_t const * p_instance, uint32_t channel);
+uint32_t   nrf_drv_rtc_counter_get(nrf_drv_rtc_t const * p_instance);
+bool       nrf_rtc_event_pending(NRF_RTC_Type * p_reg, nrf_rtc_event_t event);
+
+#endif // NRF_DRV_RTC_H__
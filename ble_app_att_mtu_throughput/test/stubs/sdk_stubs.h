@@ -0,0 +1,187 @@
+/* Host stand-ins for the parts of the nRF5 SDK and SoftDevice API the tested modules use.
+ *
+ * Types carry only the fields the application touches. The SoftDevice calls are declared here
+ * and defined by each test, which fakes the behaviour it needs.
+ */
+#ifndef SDK_STUBS_H
+#define SDK_STUBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nrf.h"
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS                     0
+#define NRF_ERROR_NULL                  0x0E
+#define NRF_ERROR_INVALID_STATE         0x08
+#define NRF_ERROR_NOT_FOUND             0x05
+#define NRF_ERROR_BUSY                  0x11
+#define NRF_ERROR_DATA_SIZE             0x0C
+#define NRF_ERROR_NO_MEM                0x04
+#define NRF_ERROR_INVALID_PARAM         0x07
+#define BLE_ERROR_NO_TX_PACKETS         0x3004
+
+#define BLE_CONN_HANDLE_INVALID         0xFFFF
+#define BLE_GATT_HANDLE_INVALID         0x0000
+#define BLE_GATT_HVX_NOTIFICATION       0x01
+#define BLE_GATT_HVX_INDICATION         0x02
+#define BLE_GATT_OP_WRITE_REQ           0x01
+#define BLE_GATT_OP_WRITE_CMD           0x02
+#define BLE_CCCD_VALUE_LEN              2
+#define BLE_GATTS_SRVC_TYPE_PRIMARY     0x01
+#define NRF_BLE_GATT_MAX_MTU_SIZE       247
+#define BLE_GATT_ATT_MTU_DEFAULT        23
+#define SEC_OPEN                        1
+
+#define MIN(a, b)                       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)                       ((a) < (b) ? (b) : (a))
+#define ARRAY_SIZE(a)                   (sizeof(a) / sizeof((a)[0]))
+#define LSB_16(a)                       ((uint8_t)((a) & 0xFF))
+#define MSB_16(a)                       ((uint8_t)(((a) >> 8) & 0xFF))
+
+#define VERIFY_PARAM_NOT_NULL(p)        do { if ((p) == NULL) { return NRF_ERROR_NULL; } } while (0)
+#define VERIFY_SUCCESS(e)               do { if ((e) != NRF_SUCCESS) { return (e); } } while (0)
+#define APP_ERROR_CHECK(e)              do { (void)(e); } while (0)
+#define APP_ERROR_CHECK_BOOL(b)         do { (void)(b); } while (0)
+#define CRITICAL_REGION_ENTER()         {
+#define CRITICAL_REGION_EXIT()          }
+
+#define NRF_LOG_ERROR(...)
+#define NRF_LOG_WARNING(...)
+#define NRF_LOG_INFO(...)
+#define NRF_LOG_DEBUG(...)
+#define NRF_LOG_RAW_INFO(...)
+
+static inline uint8_t uint16_encode(uint16_t value, uint8_t * p_encoded)
+{
+    p_encoded[0] = (uint8_t)value;
+    p_encoded[1] = (uint8_t)(value >> 8);
+    return 2;
+}
+
+static inline uint8_t uint32_encode(uint32_t value, uint8_t * p_encoded)
+{
+    p_encoded[0] = (uint8_t)value;
+    p_encoded[1] = (uint8_t)(value >> 8);
+    p_encoded[2] = (uint8_t)(value >> 16);
+    p_encoded[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+static inline uint16_t uint16_decode(uint8_t const * p_encoded)
+{
+    return (uint16_t)(p_encoded[0] | (p_encoded[1] << 8));
+}
+
+static inline uint32_t uint32_decode(uint8_t const * p_encoded)
+{
+    return (uint32_t)p_encoded[0] | ((uint32_t)p_encoded[1] << 8)
+         | ((uint32_t)p_encoded[2] << 16) | ((uint32_t)p_encoded[3] << 24);
+}
+
+/* GATT and GAP types. */
+typedef struct { uint8_t uuid128[16]; } ble_uuid128_t;
+typedef struct { uint16_t uuid; uint8_t type; } ble_uuid_t;
+typedef struct { uint16_t value_handle, user_desc_handle, cccd_handle, sccd_handle; } ble_gatts_char_handles_t;
+typedef struct { uint16_t handle; uint8_t type; uint16_t offset; uint16_t * p_len; uint8_t const * p_data; } ble_gatts_hvx_params_t;
+typedef struct { uint16_t len; uint16_t offset; uint8_t * p_value; } ble_gatts_value_t;
+typedef struct { uint8_t write_op; uint8_t flags; uint16_t handle; uint16_t offset; uint16_t len; uint8_t const * p_value; } ble_gattc_write_params_t;
+typedef struct { uint8_t broadcast:1, read:1, write_wo_resp:1, write:1, notify:1, indicate:1, auth_signed_wr:1; } ble_gatt_char_props_t;
+typedef struct
+{
+    uint16_t uuid;
+    uint8_t  uuid_type;
+    uint16_t max_len;
+    uint16_t init_len;
+    uint8_t * p_init_value;
+    bool     is_var_len;
+    ble_gatt_char_props_t char_props;
+    bool     is_defered_read;
+    bool     is_defered_write;
+    int      read_access;
+    int      write_access;
+    int      cccd_write_access;
+    bool     is_value_user;
+} ble_add_char_params_t;
+
+/* BLE events. */
+enum
+{
+    BLE_EVT_TX_COMPLETE = 0x01,
+    BLE_EVT_USER_MEM_REQUEST,
+    BLE_GAP_EVT_CONNECTED = 0x10,
+    BLE_GAP_EVT_DISCONNECTED,
+    BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP = 0x30,
+    BLE_GATTC_EVT_CHAR_DISC_RSP,
+    BLE_GATTC_EVT_DESC_DISC_RSP,
+    BLE_GATTC_EVT_READ_RSP,
+    BLE_GATTC_EVT_WRITE_RSP,
+    BLE_GATTC_EVT_HVX,
+    BLE_GATTC_EVT_EXCHANGE_MTU_RSP,
+    BLE_GATTC_EVT_TIMEOUT,
+    BLE_GATTS_EVT_WRITE = 0x50,
+    BLE_GATTS_EVT_HVC,
+    BLE_GATTS_EVT_SYS_ATTR_MISSING,
+    BLE_GATTS_EVT_TIMEOUT,
+};
+
+typedef struct { uint16_t handle; uint8_t op; uint8_t auth_required; uint16_t offset; uint16_t len; uint8_t data[1]; } ble_gatts_evt_write_t;
+typedef struct { uint16_t handle; } ble_gatts_evt_hvc_t;
+typedef struct { uint16_t conn_handle; union { ble_gatts_evt_write_t write; ble_gatts_evt_hvc_t hvc; } params; } ble_gatts_evt_t;
+typedef struct { uint16_t handle; uint8_t type; uint16_t len; uint8_t data[1]; } ble_gattc_evt_hvx_t;
+typedef struct { uint16_t handle; uint16_t offset; uint16_t len; uint8_t data[1]; } ble_gattc_evt_read_rsp_t;
+typedef struct { uint16_t handle; uint8_t write_op; uint16_t offset; uint16_t len; uint8_t data[1]; } ble_gattc_evt_write_rsp_t;
+typedef struct
+{
+    uint16_t conn_handle;
+    uint16_t gatt_status;
+    uint16_t error_handle;
+    union { ble_gattc_evt_hvx_t hvx; ble_gattc_evt_read_rsp_t read_rsp; ble_gattc_evt_write_rsp_t write_rsp; } params;
+} ble_gattc_evt_t;
+typedef struct { uint8_t reason; } ble_gap_evt_disconnected_t;
+typedef struct { uint16_t conn_handle; union { ble_gap_evt_disconnected_t disconnected; } params; } ble_gap_evt_t;
+typedef struct { uint8_t count; } ble_evt_tx_complete_t;
+typedef struct { uint16_t conn_handle; union { ble_evt_tx_complete_t tx_complete; } params; } ble_common_evt_t;
+typedef struct { uint16_t evt_id; uint16_t evt_len; } ble_evt_hdr_t;
+typedef struct
+{
+    ble_evt_hdr_t header;
+    union { ble_common_evt_t common_evt; ble_gap_evt_t gap_evt; ble_gattc_evt_t gattc_evt; ble_gatts_evt_t gatts_evt; } evt;
+} ble_evt_t;
+
+/* DB discovery and GATT modules. */
+typedef struct { uint16_t cccd_handle; struct { uint16_t handle_value; ble_uuid_t uuid; } characteristic; } ble_gatt_db_char_t;
+typedef struct { ble_uuid_t srv_uuid; uint8_t char_count; ble_gatt_db_char_t charateristics[6]; } ble_gatt_db_srv_t;
+typedef enum { BLE_DB_DISCOVERY_COMPLETE } ble_db_discovery_evt_type_t;
+typedef struct { ble_db_discovery_evt_type_t evt_type; uint16_t conn_handle; union { ble_gatt_db_srv_t discovered_db; } params; } ble_db_discovery_evt_t;
+typedef struct { int unused; } ble_db_discovery_t;
+typedef struct { uint16_t conn_handle; uint16_t att_mtu_effective; } nrf_ble_gatt_evt_t;
+typedef struct { int unused; } nrf_ble_gatt_t;
+
+/* SoftDevice and SDK calls, defined by the tests that reach them. */
+uint32_t sd_ble_tx_packet_count_get(uint16_t conn_handle, uint8_t * p_count);
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx_params);
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t * p_value);
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const * p_uuid, uint16_t * p_handle);
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type);
+uint32_t characteristic_add(uint16_t service_handle, ble_add_char_params_t * p_params, ble_gatts_char_handles_t * p_handles);
+uint32_t ble_db_discovery_evt_register(ble_uuid_t const * p_uuid);
+uint32_t sd_ble_gattc_read(uint16_t conn_handle, uint16_t handle, uint16_t offset);
+uint32_t sd_ble_gattc_write(uint16_t conn_handle, ble_gattc_write_params_t const * p_write_params);
+uint32_t sd_ble_gattc_hv_confirm(uint16_t conn_handle, uint16_t handle);
+
+static inline bool ble_srv_is_notification_enabled(uint8_t const * p_encoded_data)
+{
+    return (uint16_decode(p_encoded_data) & BLE_GATT_HVX_NOTIFICATION) != 0;
+}
+
+static inline bool ble_srv_is_indication_enabled(uint8_t const * p_encoded_data)
+{
+    return (uint16_decode(p_encoded_data) & BLE_GATT_HVX_INDICATION) != 0;
+}
+
+#endif // SDK_STUBS_H
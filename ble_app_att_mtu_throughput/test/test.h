@@ -0,0 +1,25 @@
+/* Minimal checks shared by the host tests. */
+#ifndef TEST_H__
+#define TEST_H__
+
+#include <stdio.h>
+
+static unsigned m_test_failures;   /**< Number of failed checks. */
+
+/**@brief Macro for checking a condition, printing it and carrying on if it does not hold. */
+#define TEST_CHECK(cond)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if (!(cond))                                                            \
+        {                                                                       \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);     \
+            m_test_failures++;                                                  \
+        }                                                                       \
+    } while (0)
+
+/**@brief Macro for ending a test, returns the exit code of main(). */
+#define TEST_END()                                                              \
+    (printf("%s: %s\n", __FILE__, (m_test_failures == 0) ? "passed" : "FAILED"), \
+     (m_test_failures == 0) ? 0 : 1)
+
+#endif // TEST_H__
@@ -0,0 +1,232 @@
+/* Host test of the per-transfer statistics of the AMT client (amtc.c).
+ *
+ * The statistics must start over with each transfer even when its first notification is lost,
+ * and must not be carried over a disconnection.
+ */
+#include "amt.h"
+#include "counter.h"
+#include "test.h"
+
+#define CONN_HANDLE         0
+#define AMT_HANDLE          10
+#define NOTIF_LEN           244             /**< Notification of a full 247 byte ATT MTU, header included. */
+
+static nrf_ble_amtc_t   m_amtc;
+static uint32_t         m_evt_buf[(sizeof(ble_evt_t) + NOTIF_LEN + 3) / 4];   /**< BLE event with room for the notification. */
+static uint64_t         m_ticks;                                            /**< Fake counter_now() value. */
+static uint32_t         m_start_cnt;                                        /**< Notifications flagged transfer_start. */
+
+
+uint32_t sd_ble_tx_packet_count_get(uint16_t conn_handle, uint8_t * p_count)
+{
+    *p_count = 1;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx_params)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t * p_value)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const * p_uuid, uint16_t * p_handle)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type)
+{
+    *p_uuid_type = 2;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t characteristic_add(uint16_t service_handle, ble_add_char_params_t * p_params, ble_gatts_char_handles_t * p_handles)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint32_t ble_db_discovery_evt_register(ble_uuid_t const * p_uuid)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gattc_read(uint16_t conn_handle, uint16_t handle, uint16_t offset)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gattc_write(uint16_t conn_handle, ble_gattc_write_params_t const * p_write_params)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gattc_hv_confirm(uint16_t conn_handle, uint16_t handle)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint64_t counter_now(void)
+{
+    return m_ticks;
+}
+
+
+static void amtc_evt_handler(nrf_ble_amtc_t * p_ctx, nrf_ble_amtc_evt_t * p_evt)
+{
+    if ((p_evt->evt_type == NRF_BLE_AMT_C_EVT_NOTIFICATION) && p_evt->params.hvx.transfer_start)
+    {
+        m_start_cnt++;
+    }
+}
+
+
+/**@brief Function for passing a notification of the tester to the client.
+ *
+ * @param[in] offset  Offset of the end of the notification.
+ * @param[in] len     Length of the notification, AMT_NOTIF_HDR_LEN for the end marker of a timed transfer.
+ * @param[in] flags   AMT_NOTIF_FLAG_* bits of the header.
+ */
+static void notif_send(uint32_t offset, uint16_t len, uint8_t flags)
+{
+    ble_evt_t * p_ble_evt = (ble_evt_t *)m_evt_buf;
+    uint8_t   * p_data    = p_ble_evt->evt.gattc_evt.params.hvx.data;
+
+    memset(m_evt_buf, 0, sizeof(m_evt_buf));
+    p_ble_evt->header.evt_id                     = BLE_GATTC_EVT_HVX;
+    p_ble_evt->evt.gattc_evt.conn_handle         = CONN_HANDLE;
+    p_ble_evt->evt.gattc_evt.params.hvx.handle   = AMT_HANDLE;
+    p_ble_evt->evt.gattc_evt.params.hvx.type     = BLE_GATT_HVX_NOTIFICATION;
+    p_ble_evt->evt.gattc_evt.params.hvx.len      = len;
+
+    (void) uint32_encode(offset, p_data);
+    p_data[4] = flags;
+
+    m_ticks += 100;
+    nrf_ble_amtc_on_ble_evt(&m_amtc, p_ble_evt);
+}
+
+
+/**@brief Function for receiving notifications first to last of a transfer, the last one flagged if last_flag is set. */
+static void transfer_send(uint32_t first, uint32_t last, bool last_flag)
+{
+    for (uint32_t i = first; i <= last; i++)
+    {
+        notif_send(i * NOTIF_LEN, NOTIF_LEN, ((i == last) && last_flag) ? AMT_NOTIF_FLAG_LAST : 0);
+    }
+}
+
+
+static void link_reset(void)
+{
+    nrf_ble_amtc_db_t peer_db =
+    {
+        .amt_cccd_handle  = AMT_HANDLE + 1,
+        .amt_handle       = AMT_HANDLE,
+        .amt_rbc_handle   = AMT_HANDLE + 2,
+        .amt_write_handle = AMT_HANDLE + 3,
+    };
+
+    memset(&m_amtc, 0, sizeof(m_amtc));
+    TEST_CHECK(nrf_ble_amtc_init(&m_amtc, amtc_evt_handler) == NRF_SUCCESS);
+    TEST_CHECK(nrf_ble_amtc_handles_assign(&m_amtc, CONN_HANDLE, &peer_db) == NRF_SUCCESS);
+
+    m_start_cnt = 0;
+}
+
+
+/**@brief Function for checking that a lost first notification does not merge two transfers. */
+static void test_first_lost(void)
+{
+    link_reset();
+
+    transfer_send(1, 100, true);
+    TEST_CHECK(m_amtc.seq_stats.goodput_bytes == 100 * NOTIF_LEN);
+
+    // Notification 1 of the next transfer is lost.
+    transfer_send(2, 10, true);
+    TEST_CHECK(m_start_cnt == 2);
+    TEST_CHECK(m_amtc.bytes_rcvd_cnt == 9 * NOTIF_LEN);
+    TEST_CHECK(m_amtc.seq_stats.goodput_bytes == 9 * NOTIF_LEN);
+    TEST_CHECK(m_amtc.seq_stats.gap_cnt == 1);
+    TEST_CHECK(m_amtc.seq_stats.lost_bytes == NOTIF_LEN);
+    TEST_CHECK(m_amtc.seq_stats.dup_cnt == 0);
+    TEST_CHECK(m_amtc.arrival_stats.gap_cnt == 8);
+
+    // A timed transfer ends with a bare header, the next one starts after it.
+    transfer_send(1, 50, false);
+    notif_send(50 * NOTIF_LEN, AMT_NOTIF_HDR_LEN, AMT_NOTIF_FLAG_TIMED | AMT_NOTIF_FLAG_LAST);
+    transfer_send(3, 5, true);
+    TEST_CHECK(m_start_cnt == 4);
+    TEST_CHECK(m_amtc.bytes_rcvd_cnt == 3 * NOTIF_LEN);
+    TEST_CHECK(m_amtc.seq_stats.lost_bytes == 2 * NOTIF_LEN);
+}
+
+
+/**@brief Function for checking a lost first notification after a transfer without the LAST flag. */
+static void test_no_last_flag(void)
+{
+    link_reset();
+
+    // Older testers do not flag the last notification.
+    transfer_send(1, 1000, false);
+    transfer_send(2, 10, false);
+    TEST_CHECK(m_start_cnt == 2);
+    TEST_CHECK(m_amtc.seq_stats.goodput_bytes == 9 * NOTIF_LEN);
+    TEST_CHECK(m_amtc.seq_stats.dup_cnt == 0);
+
+    // Late and repeated notifications within a transfer do not start a new one.
+    transfer_send(12, 20, false);
+    transfer_send(11, 11, false);
+    transfer_send(15, 15, false);
+    TEST_CHECK(m_start_cnt == 2);
+    TEST_CHECK(m_amtc.seq_stats.reorder_cnt == 1);
+    TEST_CHECK(m_amtc.seq_stats.dup_cnt == 1);
+    TEST_CHECK(m_amtc.seq_stats.lost_bytes == NOTIF_LEN);
+}
+
+
+/**@brief Function for checking that a disconnection clears the statistics of the transfer. */
+static void test_disconnect(void)
+{
+    link_reset();
+
+    transfer_send(1, 20, false);
+    TEST_CHECK(m_amtc.arrival_stats.first_ticks != 0);
+
+    ble_evt_t * p_ble_evt = (ble_evt_t *)m_evt_buf;
+
+    memset(m_evt_buf, 0, sizeof(m_evt_buf));
+    p_ble_evt->header.evt_id         = BLE_GAP_EVT_DISCONNECTED;
+    p_ble_evt->evt.gap_evt.conn_handle = CONN_HANDLE;
+    nrf_ble_amtc_on_ble_evt(&m_amtc, p_ble_evt);
+
+    TEST_CHECK(m_amtc.bytes_rcvd_cnt == 0);
+    TEST_CHECK(m_amtc.seq_stats.goodput_bytes == 0);
+    TEST_CHECK(m_amtc.arrival_stats.first_ticks == 0);
+    TEST_CHECK(m_amtc.arrival_stats.gap_cnt == 0);
+    TEST_CHECK(m_amtc.arrival_stats.gap_max == 0);
+}
+
+
+int main(void)
+{
+    test_first_lost();
+    test_no_last_flag();
+    test_disconnect();
+
+    return TEST_END();
+}
@@ -0,0 +1,308 @@
+/* Host test of the TX credit accounting of the AMT server (amts.c).
+ *
+ * A fake SoftDevice link holds LINK_TX_BUFFERS packets. sd_ble_gatts_hvx() fails with
+ * BLE_ERROR_NO_TX_PACKETS when they are all in use. Each connection event sends a random
+ * number of the queued packets and reports them in one BLE_EVT_TX_COMPLETE, like the
+ * SoftDevice does.
+ *
+ * The credits of the server must never exceed tx_credits_max. On a link of its own, the server
+ * must never make a call that fails. The SVC calls per MB are printed next to those of the
+ * spin-until-BUSY loop the credits replaced.
+ */
+#include <stdlib.h>
+
+#include "amt.h"
+#include "counter.h"
+#include "test.h"
+
+#define LINK_TX_BUFFERS     7               /**< TX buffers of the fake link, as reported by sd_ble_tx_packet_count_get(). */
+#define CONN_HANDLE         0
+#define ATT_MTU             247
+#define TRANSFER_BYTES      (1024 * 1024)
+#define CONN_EVT_MAX        100000          /**< Connection events after which a transfer counts as stuck. */
+
+/* Owner of a packet queued on the fake link. */
+typedef enum
+{
+    PKT_SERVER,                             //!< Notification of the AMT server. */
+    PKT_CLIENT,                             //!< Write of the AMT client on the same link, which shares the buffers. */
+} pkt_owner_t;
+
+static pkt_owner_t      m_link_queue[LINK_TX_BUFFERS];  /**< Packets queued on the fake link, oldest first. */
+static uint32_t         m_link_queued;                  /**< Number of packets in m_link_queue. */
+static uint32_t         m_hvx_calls;                    /**< Calls to sd_ble_gatts_hvx(). */
+static uint32_t         m_hvx_fails;                    /**< Calls to sd_ble_gatts_hvx() that failed with BLE_ERROR_NO_TX_PACKETS. */
+static uint64_t         m_ticks;                        /**< Fake counter_now() value. */
+static bool             m_transfer_finished;
+static uint64_t         m_finished_bytes;               /**< Byte count of the SERVICE_EVT_TRANSFER_FINISHED event. */
+static uint32_t         m_server_delivered;             /**< Notifications of the server sent by the fake link. */
+
+static nrf_ble_amts_t   m_amts;
+
+
+uint32_t sd_ble_tx_packet_count_get(uint16_t conn_handle, uint8_t * p_count)
+{
+    *p_count = LINK_TX_BUFFERS;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx_params)
+{
+    m_hvx_calls++;
+
+    if (m_link_queued == LINK_TX_BUFFERS)
+    {
+        m_hvx_fails++;
+        return BLE_ERROR_NO_TX_PACKETS;
+    }
+
+    m_link_queue[m_link_queued++] = PKT_SERVER;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t * p_value)
+{
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const * p_uuid, uint16_t * p_handle)
+{
+    *p_handle = 1;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type)
+{
+    *p_uuid_type = 2;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t characteristic_add(uint16_t service_handle, ble_add_char_params_t * p_params, ble_gatts_char_handles_t * p_handles)
+{
+    static uint16_t handle = 2;
+
+    memset(p_handles, 0, sizeof(*p_handles));
+    p_handles->value_handle = handle++;
+    return NRF_SUCCESS;
+}
+
+
+uint64_t counter_now(void)
+{
+    return m_ticks;
+}
+
+
+static void amts_evt_handler(nrf_ble_amts_evt_t evt)
+{
+    if (evt.evt_type == SERVICE_EVT_TRANSFER_FINISHED)
+    {
+        m_transfer_finished = true;
+        m_finished_bytes    = evt.bytes_transfered_cnt;
+    }
+}
+
+
+static void ble_evt_send(uint16_t evt_id, uint8_t tx_count)
+{
+    ble_evt_t evt;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.header.evt_id                            = evt_id;
+    evt.evt.common_evt.conn_handle               = CONN_HANDLE;
+    evt.evt.common_evt.params.tx_complete.count  = tx_count;
+
+    nrf_ble_amts_on_ble_evt(&m_amts, &evt);
+}
+
+
+/**@brief Function for queuing writes of the AMT client, which take buffers behind the server's back. */
+static void client_writes_queue(void)
+{
+    uint32_t cnt = (uint32_t)(rand() % 3);
+
+    while ((cnt-- > 0) && (m_link_queued < LINK_TX_BUFFERS))
+    {
+        m_link_queue[m_link_queued++] = PKT_CLIENT;
+    }
+}
+
+
+/**@brief Function for running a connection event: sends some of the queued packets and reports them.
+ *
+ * @param[in] shared  Let the AMT client queue writes in the freed buffers before the server hears of them.
+ */
+static void conn_evt_run(bool shared)
+{
+    uint32_t sent = (m_link_queued == 0) ? 0 : (uint32_t)(rand() % (m_link_queued + 1));
+
+    for (uint32_t i = 0; i < sent; i++)
+    {
+        m_server_delivered += (m_link_queue[i] == PKT_SERVER) ? 1 : 0;
+    }
+
+    memmove(&m_link_queue[0], &m_link_queue[sent], (m_link_queued - sent) * sizeof(m_link_queue[0]));
+    m_link_queued -= sent;
+    m_ticks       += 250;
+
+    if (shared)
+    {
+        client_writes_queue();
+    }
+
+    if (sent != 0)
+    {
+        ble_evt_send(BLE_EVT_TX_COMPLETE, (uint8_t)sent);
+    }
+}
+
+
+static void link_reset(void)
+{
+    memset(&m_amts, 0, sizeof(m_amts));
+    nrf_ble_amts_init(&m_amts, amts_evt_handler);
+
+    nrf_ble_gatt_evt_t gatt_evt = {.conn_handle = CONN_HANDLE, .att_mtu_effective = ATT_MTU};
+    nrf_ble_amts_on_gatt_evt(&m_amts, &gatt_evt);
+
+    m_link_queued       = 0;
+    m_hvx_calls         = 0;
+    m_hvx_fails         = 0;
+    m_transfer_finished = false;
+    m_server_delivered  = 0;
+    amt_byte_transfer_count = TRANSFER_BYTES;
+
+    ble_evt_send(BLE_GAP_EVT_CONNECTED, 0);
+}
+
+
+/**@brief Function for running a notification transfer, with or without client writes on the link. */
+static void transfer_run(bool shared)
+{
+    link_reset();
+
+    TEST_CHECK(m_amts.tx_credits == LINK_TX_BUFFERS);
+    TEST_CHECK(m_amts.tx_credits_max == LINK_TX_BUFFERS);
+
+    nrf_ble_amts_notif_spam(&m_amts);
+
+    for (uint32_t i = 0; (i < CONN_EVT_MAX) && !m_transfer_finished; i++)
+    {
+        conn_evt_run(shared);
+
+        TEST_CHECK(m_amts.tx_credits <= m_amts.tx_credits_max);
+        if (!shared)
+        {
+            // Alone on the link, the credits are exactly the free buffers.
+            TEST_CHECK(m_amts.tx_credits == LINK_TX_BUFFERS - m_link_queued);
+        }
+    }
+
+    TEST_CHECK(m_transfer_finished);
+    if (!shared)
+    {
+        TEST_CHECK(m_hvx_fails == 0);
+    }
+
+    printf("%s link: %u sd_ble_gatts_hvx() calls per MB, %u failed\n",
+           shared ? "shared" : "own", m_hvx_calls, m_hvx_fails);
+}
+
+
+/**@brief Function for counting the calls per MB of the spin-until-BUSY loop replaced by the credits. */
+static void spin_transfer_run(void)
+{
+    uint64_t sent = 0;
+    uint16_t len  = ATT_MTU - 3;
+
+    ble_gatts_hvx_params_t hvx_params = {.type = BLE_GATT_HVX_NOTIFICATION, .p_len = &len};
+
+    m_link_queued = 0;
+    m_hvx_calls   = 0;
+    m_hvx_fails   = 0;
+
+    while (sent < TRANSFER_BYTES)
+    {
+        while ((sent < TRANSFER_BYTES) && (sd_ble_gatts_hvx(CONN_HANDLE, &hvx_params) == NRF_SUCCESS))
+        {
+            sent += len;
+        }
+
+        uint32_t done = (m_link_queued == 0) ? 0 : (uint32_t)(rand() % (m_link_queued + 1));
+        memmove(&m_link_queue[0], &m_link_queue[done], (m_link_queued - done) * sizeof(m_link_queue[0]));
+        m_link_queued -= done;
+    }
+
+    printf("spin-until-BUSY: %u sd_ble_gatts_hvx() calls per MB, %u failed\n", m_hvx_calls, m_hvx_fails);
+}
+
+
+/**@brief Function for checking that TX_COMPLETE counts above the link's buffers do not add credits. */
+static void test_overcount(void)
+{
+    link_reset();
+
+    ble_evt_send(BLE_EVT_TX_COMPLETE, 3);
+    TEST_CHECK(m_amts.tx_credits == LINK_TX_BUFFERS);
+
+    ble_evt_send(BLE_EVT_TX_COMPLETE, UINT8_MAX);
+    TEST_CHECK(m_amts.tx_credits == LINK_TX_BUFFERS);
+
+    ble_evt_send(BLE_GAP_EVT_DISCONNECTED, 0);
+    TEST_CHECK(m_amts.tx_credits == 0);
+    TEST_CHECK(m_amts.tx_credits_max == 0);
+}
+
+
+/**@brief Function for checking that a timed transfer reports the bytes delivered by the deadline. */
+static void test_timed_stop(void)
+{
+    link_reset();
+    m_amts.timed = true;
+
+    nrf_ble_amts_notif_spam(&m_amts);
+
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        conn_evt_run(false);
+    }
+
+    // The deadline, with notifications still queued in the link.
+    while (m_link_queued == 0)
+    {
+        conn_evt_run(false);
+    }
+
+    uint64_t delivered = (uint64_t)m_server_delivered * m_amts.notif_len;
+    uint64_t queued    = m_amts.bytes_sent;
+
+    nrf_ble_amts_transfer_stop(&m_amts);
+
+    for (uint32_t i = 0; (i < CONN_EVT_MAX) && !m_transfer_finished; i++)
+    {
+        conn_evt_run(false);
+    }
+
+    TEST_CHECK(m_transfer_finished);
+    TEST_CHECK(m_finished_bytes == delivered);
+    TEST_CHECK(m_finished_bytes < queued);
+}
+
+
+int main(void)
+{
+    srand(1);
+
+    transfer_run(false);
+    transfer_run(true);
+    spin_transfer_run();
+    test_overcount();
+    test_timed_stop();
+
+    return TEST_END();
+}
@@ -0,0 +1,300 @@
+/* Host test of the 64-bit timebase of counter.c on a simulated RTC2.
+ *
+ * The simulated 24-bit COUNTER wraps and sets EVENTS_OVRFLW, and the test decides when the
+ * overflow interrupt is serviced. counter_now() must match the true tick count whether the
+ * interrupt is serviced late, or preempts a read, or the wrap falls between two register reads.
+ */
+#include <stdlib.h>
+
+#include "counter.h"
+#include "nrf_drv_rtc.h"
+#include "test.h"
+
+#define RTC_MASK        0xFFFFFFUL          /**< The RTC COUNTER is 24 bits wide. */
+#define RTC_WRAP        (RTC_MASK + 1)
+
+NRF_RTC_Type g_rtc2;
+
+static nrf_drv_rtc_handler_t m_rtc_handler;
+static bool                  m_cc_enabled;
+static uint64_t              m_true_ticks;      /**< The reference, counter_now() at the last rtc_reset(). */
+
+static uint32_t              m_reads;           /**< Reads of COUNTER so far. */
+static uint32_t              m_wrap_read;       /**< Read of COUNTER around which the counter wraps, 0 for none. */
+static bool                  m_wrap_after;      /**< Wrap after that read returns its value, not before. */
+static bool                  m_wrap_isr;        /**< Service the overflow interrupt right after the wrap. */
+static uint32_t              m_deadline_cnt;    /**< Calls of the deadline handler. */
+static uint64_t              m_deadline_at;     /**< The reference at the last call of the deadline handler. */
+
+
+static void rtc_advance(uint32_t n);
+
+
+ret_code_t nrf_drv_rtc_init(nrf_drv_rtc_t const * p_instance, nrf_drv_rtc_config_t const * p_config,
+                            nrf_drv_rtc_handler_t handler)
+{
+    memset(p_instance->p_reg, 0, sizeof(*p_instance->p_reg));
+    m_rtc_handler = handler;
+    return NRF_SUCCESS;
+}
+
+
+void nrf_drv_rtc_enable(nrf_drv_rtc_t const * p_instance)
+{
+}
+
+
+void nrf_drv_rtc_tick_disable(nrf_drv_rtc_t const * p_instance)
+{
+}
+
+
+void nrf_drv_rtc_overflow_enable(nrf_drv_rtc_t const * p_instance, bool enable_irq)
+{
+}
+
+
+ret_code_t nrf_drv_rtc_cc_set(nrf_drv_rtc_t const * p_instance, uint32_t channel, uint32_t val, bool enable_irq)
+{
+    p_instance->p_reg->CC[channel] = val & RTC_MASK;
+    m_cc_enabled = enable_irq;
+    return NRF_SUCCESS;
+}
+
+
+ret_code_t nrf_drv_rtc_cc_disable(nrf_drv_rtc_t const * p_instance, uint32_t channel)
+{
+    m_cc_enabled = false;
+    return NRF_SUCCESS;
+}
+
+
+/**@brief Function for letting the counter wrap, and the overflow interrupt preempt the reader. */
+static void rtc_wrap_now(void)
+{
+    rtc_advance(RTC_WRAP - g_rtc2.COUNTER);
+    if (m_wrap_isr)
+    {
+        g_rtc2.EVENTS_OVRFLW = 0;
+        m_rtc_handler(NRF_DRV_RTC_INT_OVERFLOW);
+    }
+}
+
+
+uint32_t nrf_drv_rtc_counter_get(nrf_drv_rtc_t const * p_instance)
+{
+    bool     wrap = (++m_reads == m_wrap_read);
+    uint32_t value;
+
+    if (wrap && !m_wrap_after)
+    {
+        rtc_wrap_now();
+    }
+
+    value = g_rtc2.COUNTER;
+
+    if (wrap && m_wrap_after)
+    {
+        rtc_wrap_now();
+    }
+
+    return value;
+}
+
+
+bool nrf_rtc_event_pending(NRF_RTC_Type * p_reg, nrf_rtc_event_t event)
+{
+    return (p_reg->EVENTS_OVRFLW != 0);
+}
+
+
+/**@brief Function for servicing a pending overflow interrupt. */
+static void rtc_isr_run(void)
+{
+    if (g_rtc2.EVENTS_OVRFLW)
+    {
+        g_rtc2.EVENTS_OVRFLW = 0;
+        m_rtc_handler(NRF_DRV_RTC_INT_OVERFLOW);
+    }
+}
+
+
+/**@brief Function for letting the RTC run for n ticks, firing the compare interrupt on a match. */
+static void rtc_advance(uint32_t n)
+{
+    while (n > 0)
+    {
+        uint32_t to_wrap = RTC_WRAP - g_rtc2.COUNTER;
+        uint32_t to_cc   = m_cc_enabled ? (((g_rtc2.CC[0] - g_rtc2.COUNTER - 1) & RTC_MASK) + 1) : UINT32_MAX;
+        uint32_t step    = MIN(n, MIN(to_wrap, to_cc));
+
+        g_rtc2.COUNTER = (g_rtc2.COUNTER + step) & RTC_MASK;
+        m_true_ticks  += step;
+        n             -= step;
+
+        if (step == to_wrap)
+        {
+            g_rtc2.EVENTS_OVRFLW = 1;
+        }
+        if (step == to_cc)
+        {
+            m_rtc_handler(NRF_DRV_RTC_INT_COMPARE0);
+        }
+    }
+}
+
+
+static void deadline_handler(void)
+{
+    m_deadline_cnt++;
+    m_deadline_at = m_true_ticks;
+}
+
+
+static void rtc_reset(void)
+{
+    m_reads        = 0;
+    m_wrap_read    = 0;
+    m_wrap_after   = false;
+    m_wrap_isr     = false;
+    m_cc_enabled   = false;
+    m_deadline_cnt = 0;
+
+    // The overflow count lives on across counter_init(), as counter_init() runs once on the target.
+    counter_init();
+    m_true_ticks = counter_now();
+}
+
+
+/**@brief Function for checking counter_now() over many wraps, with the overflow interrupt serviced late. */
+static void test_wraps(void)
+{
+    rtc_reset();
+
+    uint64_t const end = m_true_ticks + 20 * (uint64_t)RTC_WRAP;
+
+    while (m_true_ticks < end)
+    {
+        uint32_t step = 1 + (uint32_t)(rand() % (1 << 20));
+
+        // Late, but before the next wrap: a second one would take 512 s of interrupt latency.
+        if ((rand() % 4 == 0) || (step >= RTC_WRAP - g_rtc2.COUNTER))
+        {
+            rtc_isr_run();
+        }
+
+        rtc_advance(step);
+        TEST_CHECK(counter_now() == m_true_ticks);
+    }
+
+    // Right at the edges of a wrap.
+    rtc_isr_run();
+    rtc_advance(RTC_WRAP - g_rtc2.COUNTER - 1);
+    TEST_CHECK(counter_now() == m_true_ticks);
+    rtc_advance(1);
+    TEST_CHECK(counter_now() == m_true_ticks);
+    rtc_isr_run();
+    TEST_CHECK(counter_now() == m_true_ticks);
+}
+
+
+/**@brief Function for checking a wrap that falls inside counter_now(). */
+static void test_read_races(void)
+{
+    for (uint32_t after = 0; after <= 1; after++)
+    {
+        for (uint32_t isr = 0; isr <= 1; isr++)
+        {
+            rtc_reset();
+
+            uint64_t const start = m_true_ticks;
+
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                rtc_advance(RTC_WRAP - g_rtc2.COUNTER - ((i < 2) ? 0 : 10));
+                rtc_isr_run();
+            }
+
+            m_reads      = 0;
+            m_wrap_read  = 1;
+            m_wrap_after = (after != 0);
+            m_wrap_isr   = (isr != 0);
+
+            uint64_t now = counter_now();
+
+            m_wrap_read = 0;
+
+            TEST_CHECK(now == m_true_ticks);
+            TEST_CHECK(now == start + 3 * (uint64_t)RTC_WRAP);
+
+            rtc_isr_run();
+            now = counter_now();
+            TEST_CHECK(now == m_true_ticks);
+        }
+    }
+}
+
+
+/**@brief Function for checking that a deadline longer than a wrap ends the measurement on time. */
+static void test_deadline(void)
+{
+    uint64_t const len = 3 * (uint64_t)RTC_WRAP + 1000;
+
+    rtc_reset();
+    rtc_advance(12345);
+
+    counter_deadline_set(len, deadline_handler);
+    counter_start();
+
+    uint64_t start = m_true_ticks;
+
+    while ((m_deadline_cnt == 0) && (m_true_ticks < start + 2 * len))
+    {
+        if (g_rtc2.EVENTS_OVRFLW && (rand() % 2 == 0))
+        {
+            rtc_isr_run();
+        }
+        // Service before the next wrap, as in test_wraps().
+        if (RTC_WRAP - g_rtc2.COUNTER <= 4096)
+        {
+            rtc_isr_run();
+        }
+        rtc_advance(4096);
+    }
+
+    // Not at the earlier matches of the low 24 bits.
+    TEST_CHECK(m_deadline_cnt == 1);
+    TEST_CHECK(m_deadline_at == start + len);
+    TEST_CHECK(counter_get() == len);
+
+    // Stopped at the deadline, time goes on without it.
+    rtc_isr_run();
+    rtc_advance(RTC_WRAP);
+    rtc_isr_run();
+    TEST_CHECK(counter_get() == len);
+    TEST_CHECK(m_deadline_cnt == 1);
+
+    counter_deadline_set(0, NULL);
+}
+
+
+static void test_ticks_to_us(void)
+{
+    TEST_CHECK(counter_ticks_to_us(0) == 0);
+    TEST_CHECK(counter_ticks_to_us(COUNTER_FREQ_HZ) == 1000000);
+    TEST_CHECK(counter_ticks_to_us(RTC_WRAP) == 512000000);
+    TEST_CHECK(counter_ticks_to_us(24ULL * 3600 * COUNTER_FREQ_HZ) == 24ULL * 3600 * 1000000);
+}
+
+
+int main(void)
+{
+    srand(1);
+
+    test_wraps();
+    test_read_races();
+    test_deadline();
+    test_ticks_to_us();
+
+    return TEST_END();
+}
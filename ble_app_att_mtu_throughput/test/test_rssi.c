@@ -0,0 +1,116 @@
+/* Host test of the fixed-point RSSI average, link budget and range multiplier in rssi.h.
+ *
+ * They replaced a float moving average and a double pow(), which serve as the reference here.
+ * The fixed-point results must stay within 1 % of the reference.
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rssi.h"
+#include "test.h"
+
+#define SEQUENCE_CNT    1000    /**< Random RSSI sequences fed to the moving averages. */
+#define SEQUENCE_LEN    300     /**< Samples in each sequence, one minute of 200 ms display ticks. */
+
+
+/**@brief Reference range multiplier, as computed before with pow(). */
+static uint32_t range_multiplier_ref(uint8_t link_budget)
+{
+    double value = pow(10.0, (double)link_budget / 20.0);
+
+    return (value >= (double)UINT32_MAX) ? UINT32_MAX : (uint32_t)value;
+}
+
+
+static void test_range_multiplier(void)
+{
+    for (uint32_t link_budget = 0; link_budget <= UINT8_MAX; link_budget++)
+    {
+        uint32_t ref   = range_multiplier_ref(link_budget);
+        uint32_t fixed = rssi_range_multiplier_get(link_budget);
+
+        if (link_budget <= 100)
+        {
+            TEST_CHECK(fixed == ref);
+        }
+        TEST_CHECK(fabs((double)fixed - ref) <= 0.01 * ref);
+    }
+}
+
+
+static void test_moving_average(void)
+{
+    double   max_err_db  = 0;
+    uint32_t budget_diff = 0;
+
+    srand(1);
+
+    for (uint32_t seq = 0; seq < SEQUENCE_CNT; seq++)
+    {
+        // A link budget and TX power out of the menu, and an RSSI that drifts around a mean.
+        int8_t  tx_power    = (int8_t)((rand() % 3) * 4);
+        uint8_t link_budget = (uint8_t)(tx_power + 92 + (rand() % 12));
+        int32_t margin_q    = ((int32_t)link_budget - tx_power) << RSSI_Q_BITS;
+        int     mean        = -40 - (rand() % 60);
+
+        float   avg_ref = 0;
+        int32_t avg_q   = 0;
+
+        for (uint32_t i = 0; i < SEQUENCE_LEN; i++)
+        {
+            int rssi = mean + (rand() % 21) - 10;
+            rssi = (rssi < -127) ? -127 : rssi;
+
+            if (i == 0)
+            {
+                avg_ref = rssi;
+                avg_q   = (int32_t)rssi << RSSI_Q_BITS;
+            }
+            else
+            {
+                avg_ref = avg_ref * 0.9f + rssi * 0.1f;
+                avg_q   = rssi_average_update(avg_q, (int8_t)rssi);
+            }
+
+            double avg_fixed = (double)avg_q / (1 << RSSI_Q_BITS);
+            double err       = fabs(avg_fixed - avg_ref);
+
+            max_err_db = (err > max_err_db) ? err : max_err_db;
+            TEST_CHECK(err <= 0.01 * fabs(avg_ref));
+
+            // Truncated from a float before, so both may only part on a whole dB boundary.
+            float   budget_ref_f = (link_budget - tx_power) + avg_ref;
+            uint8_t budget_ref   = (budget_ref_f < 0) ? 0 : (uint8_t)budget_ref_f;
+            uint8_t budget       = rssi_link_budget_get(margin_q, avg_q);
+
+            TEST_CHECK(abs((int)budget - budget_ref) <= 1);
+            budget_diff += (budget != budget_ref);
+        }
+    }
+
+    printf("moving average: max error %.4f dB, link budget off by 1 dB in %u of %u samples\n",
+           max_err_db, budget_diff, SEQUENCE_CNT * SEQUENCE_LEN);
+}
+
+
+static void test_link_budget_below_sensitivity(void)
+{
+    int32_t margin_q = 96 << RSSI_Q_BITS;
+
+    TEST_CHECK(rssi_link_budget_get(margin_q, -97 << RSSI_Q_BITS) == 0);
+    TEST_CHECK(rssi_link_budget_get(margin_q, -96 << RSSI_Q_BITS) == 0);
+    TEST_CHECK(rssi_link_budget_get(margin_q, -95 << RSSI_Q_BITS) == 1);
+    TEST_CHECK(rssi_link_budget_get(margin_q, -40 << RSSI_Q_BITS) == 56);
+}
+
+
+int main(void)
+{
+    test_range_multiplier();
+    test_moving_average();
+    test_link_budget_below_sensitivity();
+
+    return TEST_END();
+}